@@ -0,0 +1,307 @@
+/*
+ *  Copyright (C) 2007 Dip. Ing. dell'Informazione, University of Pisa, Italy
+ *  http://info.iet.unipi.it/~cng/ns2mesh80216/
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA, USA
+ */
+
+/*
+ * This application reads the slot-map snapshot streams appended by the
+ * 802.16 mesh bandwidth managers ('$mac bwmanager snapshot file'), either
+ * one network-wide stream or one stream per node, and prints the average
+ * utilization of each node along with the collision statistics of the
+ * data transmissions. Averages are taken over all the frames between the
+ * first and last snapshot, including idle ones, which the stream marks. It
+ * can also write the utilization of each node and minislot as a matrix,
+ * to be rendered as a heatmap, eg. with gnuplot:
+ *
+ *   plot 'heatmap.txt' matrix with image
+ *
+ * Only the links that appear in the snapshots are checked: interference
+ * from nodes other than the transmitter is not considered, since the
+ * topology is not part of the stream.
+ */
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+//! Magic number, format version and frame marker, as in WimshBwManager.
+enum { SNAPSHOT_MAGIC = 0x504e5357, SNAPSHOT_VERSION = 2 };
+static const unsigned int SNAPSHOT_MARKER = 0xffffffff;
+
+//! State of a minislot, as in WimshBwManager.
+enum SnapshotState { SNAP_RX = 0, SNAP_TX, SNAP_UNCOORD, SNAP_N };
+
+//! State of a minislot at one node.
+struct Slot {
+	//! SNAP_RX, SNAP_TX or SNAP_UNCOORD.
+	unsigned char state_;
+	//! Channel.
+	unsigned char channel_;
+	//! Destination when transmitting, source when receiving.
+	unsigned int peer_;
+	//! Create an idle minislot.
+	Slot () : state_ (SNAP_RX), channel_ (0), peer_ (UINT_MAX) { }
+};
+
+//! Slot map of a frame, by NodeID.
+typedef std::map< unsigned int, std::vector<Slot> > Frame;
+
+//! Snapshot stream being read.
+struct Stream {
+	//! File name.
+	const char* name_;
+	//! File handle.
+	FILE* file_;
+	//! Frame of the next record, or UINT_MAX at the end of the stream.
+	unsigned int frame_;
+	//! NodeID of the next record.
+	unsigned int node_;
+};
+
+//! Read an unsigned integer of n little-endian bytes.
+static bool
+get (FILE* file, unsigned int& value, unsigned int n)
+{
+	value = 0;
+	for ( unsigned int i = 0 ; i < n ; i++ ) {
+		const int c = fgetc (file);
+		if ( c == EOF ) return false;
+		value |= (unsigned int) c << ( 8 * i );
+	}
+	return true;
+}
+
+//! Open a stream and read its header. Return the number of minislots per frame.
+static unsigned int
+openStream (Stream& s, const char* name)
+{
+	unsigned int magic, version, slots;
+
+	s.name_ = name;
+	s.file_ = fopen (name, "rb");
+	if ( ! s.file_ ) {
+		fprintf (stderr, "Error: unable to open file %s for reading\n", name);
+		exit (1);
+	}
+	if ( ! get (s.file_, magic, 4) || ! get (s.file_, version, 1) ||
+			! get (s.file_, slots, 2) ||
+			magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION ) {
+		fprintf (stderr, "Error: %s is not a slot-map snapshot stream\n", name);
+		exit (1);
+	}
+	return slots;
+}
+
+//! Read the frame and NodeID of the next record of a stream.
+static void
+next (Stream& s)
+{
+	if ( ! get (s.file_, s.frame_, 4) || ! get (s.file_, s.node_, 4) )
+		s.frame_ = UINT_MAX;
+}
+
+//! Read the runs of the current record of a stream into a slot map.
+static void
+load (Stream& s, std::vector<Slot>& map)
+{
+	unsigned int runs;
+	if ( ! get (s.file_, runs, 2) ) runs = 0;
+
+	for ( unsigned int i = 0 ; i < runs ; i++ ) {
+		unsigned int start, range, state, channel, service, peer;
+		if ( ! get (s.file_, start, 2) || ! get (s.file_, range, 2) ||
+				! get (s.file_, state, 1) || ! get (s.file_, channel, 1) ||
+				! get (s.file_, service, 1) || ! get (s.file_, peer, 4) ||
+				state >= SNAP_N || start + range > map.size() ) {
+			fprintf (stderr, "Error: corrupted record of frame %u node %u in %s\n",
+					s.frame_, s.node_, s.name_);
+			exit (1);
+		}
+		for ( unsigned int m = start ; m < start + range ; m++ ) {
+			map[m].state_ = state;
+			map[m].channel_ = channel;
+			map[m].peer_ = peer;
+		}
+	}
+}
+
+int
+main (int argc, char** argv)
+{
+	const char* heatmap = 0;
+	std::vector<const char*> names;
+
+	for ( int i = 1 ; i < argc ; i++ ) {
+		if ( strcmp (argv[i], "-h") == 0 || strcmp (argv[i], "--help") == 0 ) {
+			printf ("Usage: slotmap [-m heatmapfile] snapshotfile...\n"
+					"\nOptions:\n"
+					"  -m, --heatmap \tFile in which to write the fraction of frames\n"
+					"                \tin which each node (row) transmits data in each\n"
+					"                \tminislot (column)\n");
+			return 0;
+		} else if ( ( strcmp (argv[i], "-m") == 0 ||
+					strcmp (argv[i], "--heatmap") == 0 ) && i + 1 < argc ) {
+			heatmap = argv[++i];
+		} else {
+			names.push_back (argv[i]);
+		}
+	}
+	if ( names.empty() ) {
+		fprintf (stderr, "Error: Please supply at least one snapshot stream.\n"
+				"Try `slotmap --help' for more information.\n");
+		return 1;
+	}
+
+	// open all the streams, which must have the same frame size
+	std::vector<Stream> streams (names.size());
+	unsigned int N = 0;
+	for ( unsigned int i = 0 ; i < streams.size() ; i++ ) {
+		const unsigned int slots = openStream (streams[i], names[i]);
+		if ( i > 0 && slots != N ) {
+			fprintf (stderr, "Error: %s has %u minislots per frame instead of %u\n",
+					names[i], slots, N);
+			return 1;
+		}
+		N = slots;
+		next (streams[i]);
+	}
+
+	unsigned int first = UINT_MAX;                // first frame of the streams
+	unsigned int last = 0;                        // last frame of the streams
+	std::map< unsigned int, std::vector<double> > util;  // data tx, by node
+	std::map< unsigned int, unsigned int > uncoord;      // uncoord. MSH-DSCH, by node
+	std::set<unsigned int> nodes;                 // nodes with any record
+	double data = 0;       // minislots transmitting data
+	double collisions = 0; // ... towards a node receiving from others, too
+	double mismatches = 0; // ... towards a node receiving from someone else
+	double deaf = 0;       // ... towards a node which is transmitting
+
+	// the records of each stream are sorted by frame, thus
+	// merge the streams one frame at a time
+	for ( ;; ) {
+		unsigned int f = UINT_MAX;
+		for ( unsigned int i = 0 ; i < streams.size() ; i++ )
+			if ( streams[i].frame_ < f ) f = streams[i].frame_;
+		if ( f == UINT_MAX ) break;
+
+		// every frame is marked, even if all nodes are idle
+		if ( first == UINT_MAX ) first = f;
+		last = f;
+
+		Frame frame;
+		std::vector<Slot> marker (N);
+		for ( unsigned int i = 0 ; i < streams.size() ; i++ ) {
+			Stream& s = streams[i];
+			while ( s.frame_ == f ) {
+				if ( s.node_ == SNAPSHOT_MARKER ) {
+					load (s, marker);
+				} else {
+					std::vector<Slot>& map = frame[s.node_];
+					map.resize (N);
+					load (s, map);
+					nodes.insert (s.node_);
+				}
+				next (s);
+			}
+		}
+
+		Frame::iterator it;
+		for ( it = frame.begin() ; it != frame.end() ; ++it ) {
+			std::vector<double>& u = util[it->first];
+			u.resize (N);
+			for ( unsigned int m = 0 ; m < N ; m++ ) {
+				const Slot& x = it->second[m];
+				if ( x.state_ == SNAP_UNCOORD ) ++uncoord[it->first];
+				if ( x.state_ != SNAP_TX ) continue;
+
+				++u[m];
+				++data;
+
+				// nodes without a record in this frame are idle
+				Frame::iterator dst = frame.find (x.peer_);
+				const Slot idle;
+				const Slot& y = ( dst != frame.end() ) ? dst->second[m] : idle;
+
+				if ( y.state_ != SNAP_RX ) {
+					++deaf;
+				} else if ( y.peer_ != it->first || y.channel_ != x.channel_ ) {
+					++mismatches;
+				} else {
+					// another transmitter towards the same node on the same channel
+					Frame::iterator jt;
+					for ( jt = frame.begin() ; jt != frame.end() ; ++jt ) {
+						const Slot& z = jt->second[m];
+						if ( jt != it && z.state_ == SNAP_TX &&
+								z.peer_ == x.peer_ && z.channel_ == x.channel_ ) {
+							++collisions;
+							break;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	const unsigned int frames = ( first != UINT_MAX ) ? last - first + 1 : 0;
+	printf ("frames          %u\n", frames);
+	printf ("nodes           %u\n", (unsigned int) nodes.size());
+	printf ("minislots       %u\n", N);
+	printf ("data minislots  %.0f\n", data);
+	printf ("collisions      %.0f (%.3f%%)\n", collisions,
+			( data > 0 ) ? 100 * collisions / data : 0);
+	printf ("mismatches      %.0f (%.3f%%)\n", mismatches,
+			( data > 0 ) ? 100 * mismatches / data : 0);
+	printf ("deaf receivers  %.0f (%.3f%%)\n", deaf,
+			( data > 0 ) ? 100 * deaf / data : 0);
+
+	printf ("\n# node\tdata/frame\tuncoord/frame\n");
+	std::map< unsigned int, std::vector<double> >::iterator ut;
+	for ( ut = util.begin() ; ut != util.end() ; ++ut ) {
+		double sum = 0;
+		for ( unsigned int m = 0 ; m < N ; m++ ) sum += ut->second[m];
+		printf ("%u\t%.3f\t\t%.3f\n", ut->first,
+				( frames > 0 ) ? sum / frames : 0,
+				( frames > 0 ) ? (double) uncoord[ut->first] / frames : 0);
+	}
+
+	if ( heatmap ) {
+		FILE* os = fopen (heatmap, "w");
+		if ( ! os ) {
+			fprintf (stderr, "Error: unable to open file %s for writing\n", heatmap);
+			return 1;
+		}
+		fprintf (os, "# rows: nodes");
+		for ( ut = util.begin() ; ut != util.end() ; ++ut )
+			fprintf (os, " %u", ut->first);
+		fprintf (os, "; columns: minislots 0-%u\n", ( N > 0 ) ? N - 1 : 0);
+		for ( ut = util.begin() ; ut != util.end() ; ++ut ) {
+			for ( unsigned int m = 0 ; m < N ; m++ )
+				fprintf (os, "%s%.4f", ( m > 0 ) ? " " : "",
+						( frames > 0 ) ? ut->second[m] / frames : 0);
+			fprintf (os, "\n");
+		}
+		fclose (os);
+	}
+
+	for ( unsigned int i = 0 ; i < streams.size() ; i++ ) fclose (streams[i].file_);
+	return 0;
+}
@@ -21,26 +21,77 @@
 #define __NS2_WIMAX_CIRCULAR_H
 
 #include <list>
+#include <vector>
 #include <assert.h>
 
+//! Hash function of the elements of a CircularList.
+/*!
+  By default, the element must provide an unsigned int hash() const
+  function. Equal elements must have the same hash value.
+  */
+template<typename T>
+struct CircularHash {
+	static unsigned int hash (const T& t) { return t.hash (); }
+};
+
+//! Hash function of unsigned integers, ie. the identity.
+template<>
+struct CircularHash<unsigned int> {
+	static unsigned int hash (const unsigned int& t) { return t; }
+};
+
 //! Circular list of elements.
+/*!
+  Elements are stored into a contiguous array of nodes, linked in a
+  ring by their indices, so that the relative order of elements and the
+  current position are preserved on insert/erase. Removed nodes are
+  reused by subsequent insertions.
+
+  A hash index on the elements, see CircularHash, allows for checking
+  the membership of an element, and for moving the current position
+  to it, in constant (expected) time.
+
+  Note that inserting an element may reallocate the array of nodes,
+  thus references to the elements are only valid until next insert().
+  */
 template<typename T>
 class CircularList {
 	// Friend of WimaxDebug so that it can print out lists.
 	friend class WimaxDebug;
 
-	//! Internal list structure.
-	std::list<T> list_;
+	//! Node of the ring.
+	struct Node {
+		//! Element.
+		T value_;
+		//! Index of the next node in the ring.
+		unsigned int next_;
+		//! Index of the previous node in the ring.
+		unsigned int prev_;
+		//! Create an unlinked node.
+		Node (const T& value = T()) : value_ (value), next_ (0), prev_ (0) { }
+	};
+
+	//! Array of nodes, both in the ring and free.
+	std::vector<Node> nodes_;
 
-	//! Pointer to the current element.
-	typename std::list<T >::iterator cur_;
+	//! Indices of the free nodes.
+	std::vector<unsigned int> free_;
+
+	//! Hash buckets of node indices. The number of buckets is a power of two.
+	std::vector< std::vector<unsigned int> > buckets_;
+
+	//! Shift of the hash values, ie. 32 minus the log2 of the number of buckets.
+	unsigned int shift_;
+
+	//! Index of the current node.
+	unsigned int cur_;
 
 	//! Number of elements.
 	unsigned int size_;
 
 public:
 	//! Create an empty circular list.
-	CircularList () { size_ = 0; }
+	CircularList () : buckets_ (8), shift_ (29), cur_ (0), size_ (0) { }
 	//! Do nothing.
 	~CircularList () { }
 
@@ -50,47 +101,84 @@ public:
 	//! Return the number of elements.
 	unsigned int size () { return size_; }
 
+	//! Return the number of bytes allocated by the list, not by its elements.
+	unsigned long memory () const {
+		unsigned long bytes = nodes_.capacity() * sizeof(Node) +
+			free_.capacity() * sizeof(unsigned int) +
+			buckets_.capacity() * sizeof(std::vector<unsigned int>);
+		for ( unsigned int b = 0 ; b < buckets_.size() ; b++ )
+			bytes += buckets_[b].capacity() * sizeof(unsigned int);
+		return bytes; }
+
 	//! Return true if a given element is in the list.
-	bool find (const T& t) {
-		if ( size_ == 0 ) return false;
-		typename std::list<T>::iterator it;
-		for ( it = list_.begin() ; it != list_.end() && *it != t ; ++it ) { }
-		if ( it == list_.end() ) return false;
-		return true;
-	}
+	bool find (const T& t) { return ( lookup (t) < nodes_.size() ); }
 
 	//! Finds an element in the list and return it.
 	/*!
 	  The element returned is only meaningful if valid == true.
 	  */
 	T& find (T& t, bool& valid) {
-		if ( size_ == 0 ) { valid = false; return t; }
-		typename std::list<T>::iterator it;
-		for ( it = list_.begin() ; it != list_.end() && *it != t ; ++it ) { }
-		if ( it == list_.end() ) { valid = false; return t; }
-		valid = true;
-		return *it;
+		const unsigned int i = lookup (t);
+		valid = ( i < nodes_.size() );
+		return ( valid ) ? nodes_[i].value_ : t;
+	}
+
+	//! Move the current position to a given element.
+	/*!
+	  Return false, and leave the current position unchanged, if the
+	  element is not in the list.
+	  */
+	bool seek (const T& t) {
+		const unsigned int i = lookup (t);
+		if ( i >= nodes_.size() ) return false;
+		cur_ = i;
+		return true;
 	}
 
 	//! Insert a new element before the current position.
 	void insert (const T& t) {
-		if ( size_ == 0 ) { list_.push_back (t); cur_ = list_.begin(); }
-		else list_.insert (cur_, t);
+		if ( size_ >= buckets_.size() ) rehash ();
+
+		unsigned int i;
+		if ( free_.empty() ) { i = nodes_.size(); nodes_.push_back (Node (t)); }
+		else { i = free_.back(); free_.pop_back(); nodes_[i].value_ = t; }
+
+		if ( size_ == 0 ) {
+			nodes_[i].next_ = nodes_[i].prev_ = i;
+			cur_ = i;
+		} else {
+			const unsigned int prev = nodes_[cur_].prev_;
+			nodes_[i].next_ = cur_;
+			nodes_[i].prev_ = prev;
+			nodes_[prev].next_ = i;
+			nodes_[cur_].prev_ = i;
+		}
 		++size_;
+		buckets_[bucket (t)].push_back (i);
 	}
 
 	//! Removes the element at the current position.
 	void erase () {
 		if ( size_ == 0 ) return;
-		typename std::list<T>::iterator drop = cur_++;
-		if ( cur_ == list_.end() ) cur_ = list_.begin();
-		list_.erase (drop);
+		const unsigned int drop = cur_;
+
+		// remove the node from its hash bucket
+		std::vector<unsigned int>& b = buckets_[bucket (nodes_[drop].value_)];
+		for ( unsigned int k = 0 ; k < b.size() ; k++ )
+			if ( b[k] == drop ) { b[k] = b.back(); b.pop_back(); break; }
+
+		// unlink it from the ring
+		cur_ = nodes_[drop].next_;
+		nodes_[nodes_[drop].prev_].next_ = cur_;
+		nodes_[cur_].prev_ = nodes_[drop].prev_;
+		nodes_[drop].value_ = T();
+		free_.push_back (drop);
 		--size_;
 	}
 
 	//! Moves the pointer to the next element in a circular fashion.
 	void move () {
-		if ( size_ > 0 && ++cur_ == list_.end() ) cur_ = list_.begin(); }
+		if ( size_ > 0 ) cur_ = nodes_[cur_].next_; }
 
 	//! Return the current element.
 	/*!
@@ -98,13 +186,40 @@ public:
 	  may also crash program execution. We use an assert here since
 	  we do not want to use exception, which would be the right thing to do.
 	  */
-	const T& current () const { assert ( size_ > 0 ); return *cur_; }
+	const T& current () const { assert ( size_ > 0 ); return nodes_[cur_].value_; }
 
 	//! Return the current element.
-	T& current () { assert ( size_ > 0 ); return *cur_; }
+	T& current () { assert ( size_ > 0 ); return nodes_[cur_].value_; }
+
+	//! Return the elements, starting from the current one.
+	std::list<T> list () {
+		std::list<T> l;
+		for ( unsigned int i = 0, n = cur_ ; i < size_ ; i++, n = nodes_[n].next_ )
+			l.push_back (nodes_[n].value_);
+		return l;
+	}
 
-	//! Return internal structure
-	std::list<T> list () { return list_; }
+private:
+	//! Return the hash bucket of an element (multiplicative hashing).
+	unsigned int bucket (const T& t) const {
+		return (unsigned int) ( CircularHash<T>::hash (t) * 2654435761U ) >> shift_; }
+
+	//! Return the index of the node of an element, or nodes_.size() if none.
+	unsigned int lookup (const T& t) {
+		if ( size_ == 0 ) return nodes_.size();
+		const std::vector<unsigned int>& b = buckets_[bucket (t)];
+		for ( unsigned int k = 0 ; k < b.size() ; k++ )
+			if ( ! ( nodes_[b[k]].value_ != t ) ) return b[k];
+		return nodes_.size();
+	}
+
+	//! Double the number of buckets and redistribute the elements.
+	void rehash () {
+		buckets_.assign (2 * buckets_.size(), std::vector<unsigned int> ());
+		--shift_;
+		for ( unsigned int i = 0, k = cur_ ; i < size_ ; i++, k = nodes_[k].next_ )
+			buckets_[bucket (nodes_[k].value_)].push_back (k);
+	}
 };
 
 #endif // __NS2_WIMAX_CIRCULAR_H
@@ -276,8 +276,9 @@ WimaxDebug::print (CircularList<wimax::LinkId>& list,
 		fprintf (os, " empty\n");
 		return;
 	}
+	std::list<wimax::LinkId> elems = list.list ();
 	std::list<wimax::LinkId>::iterator it;
-	for ( it = list.list_.begin() ; it != list.list_.end() ; ++it ) {
+	for ( it = elems.begin() ; it != elems.end() ; ++it ) {
 		fprintf (os, " %d,%s", it->ndx_, (it->dir_ == wimax::IN) ? "in" : "out");
 	}
 	fprintf (os, "\n");
@@ -293,8 +294,9 @@ WimaxDebug::print (CircularList<unsigned int>& list,
 		fprintf (os, " empty\n");
 		return;
 	}
+	std::list<unsigned int> elems = list.list ();
 	std::list<unsigned int>::iterator it;
-	for ( it = list.list_.begin() ; it != list.list_.end() ; ++it ) {
+	for ( it = elems.begin() ; it != elems.end() ; ++it ) {
 		fprintf (os, " %d", *it);
 	}
 	fprintf (os, "\n");
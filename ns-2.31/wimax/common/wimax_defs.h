@@ -74,6 +74,9 @@ struct LinkId {
 	//! Return false if either ndx_ or dir_ are different.
 	bool operator!= (const LinkId& x) {
 		return ( x.ndx_ != ndx_ || x.dir_ != dir_ || x.service_ != service_ ); }
+	//! Hash value, used by CircularList.
+	unsigned int hash () const {
+		return ( ndx_ * 2 + dir_ ) * 256 + service_; }
 };
 
 //! Next-hop and number of hops towards a destination
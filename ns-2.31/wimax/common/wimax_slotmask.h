@@ -0,0 +1,301 @@
+/*
+ *  Copyright (C) 2007 Dip. Ing. dell'Informazione, University of Pisa, Italy
+ *  http://info.iet.unipi.it/~cng/ns2mesh80216/
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA, USA
+ */
+
+#ifndef __NS2_WIMAX_SLOTMASK_H
+#define __NS2_WIMAX_SLOTMASK_H
+
+#include <stdint.h>
+
+//! This macro can be used to enable the AVX2 code path of bulk operations.
+/*!
+  The AVX2 path is only used for 256-bit masks. It requires the
+  code to be compiled with AVX2 support (e.g. -mavx2), otherwise
+  the build fails. Leave it undefined to use 64-bit words only.
+  */
+// #define WIMAX_AVX2
+
+#ifdef WIMAX_AVX2
+#ifndef __AVX2__
+#error "WIMAX_AVX2 requires the compiler to target AVX2 (eg. -mavx2)"
+#endif
+#include <immintrin.h>
+#endif
+
+//! Bitmask of minislots within a frame, stored as an array of 64-bit words.
+/*!
+  A set bit usually means that the minislot is not available.
+
+  Search functions work on a half-open interval [from, to[ of minislots
+  and return 'to' if the requested bit/run is not found. They test
+  a whole word at a time, so that looking for a run of k free minislots
+  costs a few operations per run rather than one per minislot.
+
+  The bits beyond BITS in the last word are always clear.
+  */
+template<unsigned int BITS = 256>
+class WimaxSlotMask {
+public:
+	//! Number of 64-bit words.
+	enum { WORDS = ( BITS + 63 ) / 64 };
+
+protected:
+	//! Array of words. Bit i is bit (i % 64) of word (i / 64).
+	uint64_t w_[WORDS];
+
+public:
+	//! Create a mask with all the bits clear.
+	WimaxSlotMask () { reset (); }
+
+	//! Return a mask with the bits [start, start + len[ set.
+	static WimaxSlotMask range (unsigned int start, unsigned int len) {
+		WimaxSlotMask m; m.set (start, len, true); return m; }
+
+	//! Return the value of bit i.
+	bool operator[] (unsigned int i) const {
+		return ( w_[i >> 6] >> ( i & 63 ) ) & 1; }
+	//! Return the value of bit i.
+	bool test (unsigned int i) const { return (*this)[i]; }
+
+	//! Set all the bits.
+	void set () {
+		for ( unsigned int i = 0 ; i < WORDS ; i++ ) w_[i] = ~(uint64_t) 0;
+		trim (); }
+	//! Clear all the bits.
+	void reset () {
+		for ( unsigned int i = 0 ; i < WORDS ; i++ ) w_[i] = 0; }
+	//! Set bit i.
+	void set (unsigned int i) { w_[i >> 6] |= (uint64_t) 1 << ( i & 63 ); }
+	//! Clear bit i.
+	void reset (unsigned int i) { w_[i >> 6] &= ~( (uint64_t) 1 << ( i & 63 ) ); }
+	//! Set the bits [start, start + len[ to a given value.
+	void set (unsigned int start, unsigned int len, bool value);
+
+	//! Return the number of bits set.
+	unsigned int count () const {
+		unsigned int n = 0;
+		for ( unsigned int i = 0 ; i < WORDS ; i++ )
+			n += __builtin_popcountll (w_[i]);
+		return n; }
+	//! Return the number of bits set in [from, to[.
+	unsigned int count (unsigned int from, unsigned int to) const {
+		WimaxSlotMask m = range (from, ( to > from ) ? to - from : 0);
+		m &= *this;
+		return m.count (); }
+
+	//! Return true if no bit is set.
+	bool none () const;
+	//! Return true if at least one bit is set.
+	bool any () const { return ! none (); }
+
+	//! Bitwise or.
+	WimaxSlotMask& operator|= (const WimaxSlotMask& m);
+	//! Bitwise and.
+	WimaxSlotMask& operator&= (const WimaxSlotMask& m);
+	//! Clear the bits that are set in m, ie. bitwise and with the complement.
+	WimaxSlotMask& andNot (const WimaxSlotMask& m);
+
+	//! Return the bitwise or of two masks.
+	WimaxSlotMask operator| (const WimaxSlotMask& m) const {
+		WimaxSlotMask r (*this); r |= m; return r; }
+	//! Return the bitwise and of two masks.
+	WimaxSlotMask operator& (const WimaxSlotMask& m) const {
+		WimaxSlotMask r (*this); r &= m; return r; }
+	//! Return the complement of this mask.
+	WimaxSlotMask operator~ () const {
+		WimaxSlotMask r;
+		for ( unsigned int i = 0 ; i < WORDS ; i++ ) r.w_[i] = ~w_[i];
+		r.trim ();
+		return r; }
+	//! Return true if two masks are equal.
+	bool operator== (const WimaxSlotMask& m) const {
+		for ( unsigned int i = 0 ; i < WORDS ; i++ )
+			if ( w_[i] != m.w_[i] ) return false;
+		return true; }
+
+	//! Return the first bit set in [from, to[, or to.
+	unsigned int firstOne (unsigned int from, unsigned int to) const {
+		return first (from, to, 0); }
+	//! Return the first bit clear in [from, to[, or to.
+	unsigned int firstZero (unsigned int from, unsigned int to) const {
+		return first (from, to, ~(uint64_t) 0); }
+	//! Return the last bit set in [from, to[, or to.
+	unsigned int lastOne (unsigned int from, unsigned int to) const {
+		return last (from, to, 0); }
+	//! Return the last bit clear in [from, to[, or to.
+	unsigned int lastZero (unsigned int from, unsigned int to) const {
+		return last (from, to, ~(uint64_t) 0); }
+
+	//! Return the first bit of the first run of at least k clear bits in [from, to[, or to.
+	unsigned int findZeroRun (unsigned int k,
+			unsigned int from, unsigned int to) const;
+
+	//! Return the length of the run of clear bits starting at from, up to to.
+	unsigned int zeroRun (unsigned int from, unsigned int to) const {
+		return firstOne (from, to) - from; }
+
+protected:
+	//! Clear the unused bits of the last word.
+	void trim () {
+		if ( BITS % 64 ) w_[WORDS - 1] &= ~(uint64_t) 0 >> ( 64 - BITS % 64 ); }
+	//! First bit in [from, to[ of the mask xor'ed with x which is set.
+	unsigned int first (unsigned int from, unsigned int to, uint64_t x) const;
+	//! Last bit in [from, to[ of the mask xor'ed with x which is set.
+	unsigned int last (unsigned int from, unsigned int to, uint64_t x) const;
+};
+
+template<unsigned int BITS>
+void
+WimaxSlotMask<BITS>::set (unsigned int start, unsigned int len, bool value)
+{
+	unsigned int end = start + len;
+	if ( end > BITS ) end = BITS;
+
+	// set/clear the bits one word at a time
+	while ( start < end ) {
+		const unsigned int i = start >> 6;
+		const unsigned int lo = start & 63;
+		const unsigned int n = ( end - start < 64 - lo ) ? end - start : 64 - lo;
+		const uint64_t bits =
+			( ( n == 64 ) ? ~(uint64_t) 0 : ( ( (uint64_t) 1 << n ) - 1 ) ) << lo;
+		if ( value ) w_[i] |= bits;
+		else         w_[i] &= ~bits;
+		start += n;
+	}
+}
+
+template<unsigned int BITS>
+bool
+WimaxSlotMask<BITS>::none () const
+{
+#ifdef WIMAX_AVX2
+	if ( WORDS == 4 ) {
+		const __m256i a = _mm256_loadu_si256 ((const __m256i*) w_);
+		return _mm256_testz_si256 (a, a);
+	}
+#endif
+	uint64_t x = 0;
+	for ( unsigned int i = 0 ; i < WORDS ; i++ ) x |= w_[i];
+	return ( x == 0 );
+}
+
+template<unsigned int BITS>
+WimaxSlotMask<BITS>&
+WimaxSlotMask<BITS>::operator|= (const WimaxSlotMask& m)
+{
+#ifdef WIMAX_AVX2
+	if ( WORDS == 4 ) {
+		_mm256_storeu_si256 ((__m256i*) w_, _mm256_or_si256 (
+				_mm256_loadu_si256 ((const __m256i*) w_),
+				_mm256_loadu_si256 ((const __m256i*) m.w_)));
+		return *this;
+	}
+#endif
+	for ( unsigned int i = 0 ; i < WORDS ; i++ ) w_[i] |= m.w_[i];
+	return *this;
+}
+
+template<unsigned int BITS>
+WimaxSlotMask<BITS>&
+WimaxSlotMask<BITS>::operator&= (const WimaxSlotMask& m)
+{
+#ifdef WIMAX_AVX2
+	if ( WORDS == 4 ) {
+		_mm256_storeu_si256 ((__m256i*) w_, _mm256_and_si256 (
+				_mm256_loadu_si256 ((const __m256i*) w_),
+				_mm256_loadu_si256 ((const __m256i*) m.w_)));
+		return *this;
+	}
+#endif
+	for ( unsigned int i = 0 ; i < WORDS ; i++ ) w_[i] &= m.w_[i];
+	return *this;
+}
+
+template<unsigned int BITS>
+WimaxSlotMask<BITS>&
+WimaxSlotMask<BITS>::andNot (const WimaxSlotMask& m)
+{
+#ifdef WIMAX_AVX2
+	if ( WORDS == 4 ) {
+		// note that _mm256_andnot_si256 complements its first argument
+		_mm256_storeu_si256 ((__m256i*) w_, _mm256_andnot_si256 (
+				_mm256_loadu_si256 ((const __m256i*) m.w_),
+				_mm256_loadu_si256 ((const __m256i*) w_)));
+		return *this;
+	}
+#endif
+	for ( unsigned int i = 0 ; i < WORDS ; i++ ) w_[i] &= ~m.w_[i];
+	return *this;
+}
+
+template<unsigned int BITS>
+unsigned int
+WimaxSlotMask<BITS>::first (unsigned int from, unsigned int to, uint64_t x) const
+{
+	if ( to > BITS ) to = BITS;
+	if ( from >= to ) return to;
+
+	unsigned int i = from >> 6;
+	uint64_t word = ( w_[i] ^ x ) & ( ~(uint64_t) 0 << ( from & 63 ) );
+	for ( ;; ) {
+		if ( word ) {
+			const unsigned int b = ( i << 6 ) + __builtin_ctzll (word);
+			return ( b < to ) ? b : to;
+		}
+		if ( ++i >= WORDS || ( i << 6 ) >= to ) return to;
+		word = w_[i] ^ x;
+	}
+}
+
+template<unsigned int BITS>
+unsigned int
+WimaxSlotMask<BITS>::last (unsigned int from, unsigned int to, uint64_t x) const
+{
+	if ( to > BITS ) to = BITS;
+	if ( from >= to ) return to;
+
+	unsigned int i = ( to - 1 ) >> 6;
+	uint64_t word = ( w_[i] ^ x ) & ( ~(uint64_t) 0 >> ( 63 - ( ( to - 1 ) & 63 ) ) );
+	for ( ;; ) {
+		if ( word ) {
+			const unsigned int b = ( i << 6 ) + 63 - __builtin_clzll (word);
+			return ( b >= from ) ? b : to;
+		}
+		if ( ( i << 6 ) <= from ) return to;
+		word = w_[--i] ^ x;
+	}
+}
+
+template<unsigned int BITS>
+unsigned int
+WimaxSlotMask<BITS>::findZeroRun (unsigned int k,
+		unsigned int from, unsigned int to) const
+{
+	if ( to > BITS ) to = BITS;
+
+	// jump from one run of clear bits to the next one
+	unsigned int s = firstZero (from, to);
+	while ( s < to ) {
+		const unsigned int e = firstOne (s, to);
+		if ( e - s >= k ) return s;
+		s = firstZero (e, to);
+	}
+	return to;
+}
+
+#endif // __NS2_WIMAX_SLOTMASK_H
@@ -0,0 +1,307 @@
+/*
+ *  Copyright (C) 2007 Dip. Ing. dell'Informazione, University of Pisa, Italy
+ *  http://info.iet.unipi.it/~cng/ns2mesh80216/
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA, USA
+ */
+
+#ifndef __NS2_WIMSH_ALLOC_H
+#define __NS2_WIMSH_ALLOC_H
+
+#include <wimax_common.h>
+#include <wimax_debug.h>
+#include <wimax_slotmask.h>
+
+#include <vector>
+
+#include <limits.h>
+#include <stdio.h>
+
+//! Allocation table of a bandwidth manager, run-length encoded.
+/*!
+  Stores, for each minislot of each frame over a time horizon of H frames
+  (modulo H), the direction (tx/rx), destination, source, channel, service
+  class and uncoordinated MSH-DSCH destination that the bandwidth manager
+  uses to drive the MAC layer.
+
+  Each frame is stored as a sorted vector of runs, ie. ranges of
+  consecutive minislots with the same attributes, which cover all
+  the S minislots of the frame. Adjacent runs always have different
+  attributes. An empty frame is a single run.
+
+  Frames are addressed modulo H, ie. frame f refers to the only frame
+  in [current, current + H[ that is equal to f modulo H. Each frame is
+  tagged with the (absolute) frame number it belongs to: when the
+  current frame is advanced, the frame just elapsed becomes stale, and
+  it is reset on its next access only. The runs of the service class
+  specified at construction (ie. UGS) survive, apart from their
+  uncoordinated MSH-DSCH destination, whereas all the other ones are
+  restored to default.
+  */
+template<unsigned int H, unsigned int S>
+class WimshAllocTable {
+public:
+	//! Attributes of a run, to be used with set() and match().
+	enum Field {
+		F_TX      = 1 << 0,
+		F_DST     = 1 << 1,
+		F_SRC     = 1 << 2,
+		F_CHANNEL = 1 << 3,
+		F_SERVICE = 1 << 4,
+		F_UNCOORD = 1 << 5
+	};
+
+	//! Value of the service class of a minislot that is not allocated.
+	enum { NO_SERVICE = 9 };
+
+	//! Range of minislots with the same attributes.
+	struct Run {
+		//! First minislot.
+		unsigned short start_;
+		//! Number of minislots.
+		unsigned short range_;
+		//! True if granted for transmission, false for reception.
+		bool tx_;
+		//! Service class, NO_SERVICE if not allocated.
+		unsigned char service_;
+		//! Channel identifier.
+		unsigned int channel_;
+		//! Destination of the grant (only meaningful with tx).
+		WimaxNodeId dst_;
+		//! Source of the grant.
+		WimaxNodeId src_;
+		//! Destination of the uncoordinated MSH-DSCH, UINT_MAX if none.
+		WimaxNodeId uncoord_;
+
+		//! Create a run with default attributes.
+		/*!
+		  Note that there is the following (bad) trick. The channel is
+		  initialized to 'zero' and the direction to 'receive'. Therefore,
+		  whenever a node does not send a confirmation (ie. it does not use
+		  that slot for transmission) and does not receive a confirmation
+		  addressed to itself (ie. it does not receive from a neighbor in
+		  that slot) then the slot is automatically used for reception from
+		  the 'zero' channel, which is the control channel. This allows for
+		  uncoordinated scheduling to be implemented without any modification,
+		  *but* only works provided that the control channel used by the MAC
+		  is always 'zero'.
+		  */
+		Run (unsigned int start = 0, unsigned int range = S) :
+			start_ (start), range_ (range), tx_ (false),
+			service_ (NO_SERVICE), channel_ (0),
+			dst_ (UINT_MAX), src_ (UINT_MAX), uncoord_ (UINT_MAX) { }
+
+		//! Return the minislot after the last one of this run.
+		unsigned int end () const { return start_ + range_; }
+
+		//! Return true if the selected attributes are equal to those of r.
+		bool match (const Run& r, unsigned int fields = ~0U) const {
+			return ( ! ( fields & F_TX ) || tx_ == r.tx_ ) &&
+				( ! ( fields & F_DST ) || dst_ == r.dst_ ) &&
+				( ! ( fields & F_SRC ) || src_ == r.src_ ) &&
+				( ! ( fields & F_CHANNEL ) || channel_ == r.channel_ ) &&
+				( ! ( fields & F_SERVICE ) || service_ == r.service_ ) &&
+				( ! ( fields & F_UNCOORD ) || uncoord_ == r.uncoord_ ); }
+
+		//! Set one attribute to a given value.
+		void assign (Field field, unsigned int value) {
+			switch ( field ) {
+				case F_TX:      tx_ = ( value != 0 ); break;
+				case F_DST:     dst_ = value; break;
+				case F_SRC:     src_ = value; break;
+				case F_CHANNEL: channel_ = value; break;
+				case F_SERVICE: service_ = (unsigned char) value; break;
+				case F_UNCOORD: uncoord_ = value; break;
+			} }
+	};
+
+	//! A minislot bitmap of a frame, as returned by match().
+	typedef WimaxSlotMask<S> Mask;
+
+protected:
+	//! Array of frames, each one a sorted vector of runs.
+	/*!
+	  Stale frames are reset on access, hence this is mutable.
+	  */
+	mutable std::vector< std::vector<Run> > frames_;
+	//! Frame number each frame belongs to.
+	mutable std::vector<unsigned int> epoch_;
+	//! Current frame number.
+	unsigned int now_;
+	//! Service class whose runs are kept when a frame elapses.
+	unsigned char keep_;
+
+public:
+	//! Create a table with all the frames empty.
+	WimshAllocTable (unsigned char keep = NO_SERVICE) :
+		frames_ (H, std::vector<Run> (1, Run ())), epoch_ (H), now_ (0), keep_ (keep) {
+		for ( unsigned int b = 0 ; b < H ; b++ ) epoch_[b] = b; }
+	//! Do nothing.
+	~WimshAllocTable () { }
+
+	//! Set the current frame. Elapsed frames become stale.
+	void advance (unsigned int frame) { now_ = frame; }
+
+	//! Return the runs of frame f (modulo H).
+	const std::vector<Run>& runs (unsigned int f) const { return frame (f); }
+
+	//! Return the index of the run containing minislot s of frame f.
+	unsigned int find (unsigned int f, unsigned int s) const;
+
+	//! Return the run containing minislot s of frame f.
+	const Run& at (unsigned int f, unsigned int s) const {
+		return frame (f)[find (f, s)]; }
+
+	//! Return the minislots of frame f whose selected attributes are equal to key's.
+	Mask match (unsigned int f, const Run& key, unsigned int fields) const {
+		Mask m; match (f, key, fields, m); return m; }
+
+	//! Set the minislots of frame f whose selected attributes are equal to key's.
+	/*!
+	  The bitmap m may be narrower than S minislots, in which case the
+	  minislots beyond its capacity are ignored.
+	  */
+	template<class M>
+	void match (unsigned int f, const Run& key, unsigned int fields, M& m) const {
+		const std::vector<Run>& v = frame (f);
+		for ( unsigned int i = 0 ; i < v.size() ; i++ )
+			if ( v[i].match (key, fields) ) m.set (v[i].start_, v[i].range_, true); }
+
+	//! Set an attribute of a range of minislots over a range of frames.
+	void set (Field field,
+			unsigned int fstart, unsigned int frange,
+			unsigned int mstart, unsigned int mrange, unsigned int value);
+
+	//! Return the number of bytes allocated by the table.
+	unsigned long memory () const {
+		unsigned long bytes = frames_.capacity() * sizeof(std::vector<Run>) +
+			epoch_.capacity() * sizeof(unsigned int);
+		for ( unsigned int b = 0 ; b < frames_.size() ; b++ )
+			bytes += frames_[b].capacity() * sizeof(Run);
+		return bytes; }
+
+	//! Replace the runs of frame f, which must cover all the S minislots.
+	void assign (unsigned int f, const std::vector<Run>& v) {
+		std::vector<Run>& r = frame (f); r = v; merge (r); }
+
+protected:
+	//! Return the runs of frame f, after resetting them if stale.
+	std::vector<Run>& frame (unsigned int f) const;
+
+	//! Split the run containing minislot s of v so that a run starts at s.
+	/*!
+	  Return the index of the run starting at s, or the number of runs
+	  if s is beyond the last minislot.
+	  */
+	static unsigned int split (std::vector<Run>& v, unsigned int s);
+
+	//! Merge the adjacent runs of v having the same attributes.
+	static void merge (std::vector<Run>& v);
+};
+
+template<unsigned int H, unsigned int S>
+unsigned int
+WimshAllocTable<H, S>::find (unsigned int f, unsigned int s) const
+{
+	const std::vector<Run>& v = frame (f);
+
+	// binary search of the last run starting at or before s
+	unsigned int lo = 0, hi = v.size();
+	while ( hi - lo > 1 ) {
+		const unsigned int mid = ( lo + hi ) / 2;
+		if ( v[mid].start_ <= s ) lo = mid;
+		else                      hi = mid;
+	}
+	return lo;
+}
+
+template<unsigned int H, unsigned int S>
+unsigned int
+WimshAllocTable<H, S>::split (std::vector<Run>& v, unsigned int s)
+{
+	if ( s >= S ) return v.size();
+
+	unsigned int lo = 0, hi = v.size();
+	while ( hi - lo > 1 ) {
+		const unsigned int mid = ( lo + hi ) / 2;
+		if ( v[mid].start_ <= s ) lo = mid;
+		else                      hi = mid;
+	}
+	if ( v[lo].start_ == s ) return lo;
+
+	// cut the run in two at s
+	Run tail = v[lo];
+	tail.start_ = s;
+	tail.range_ = v[lo].end() - s;
+	v[lo].range_ = s - v[lo].start_;
+	v.insert (v.begin() + lo + 1, tail);
+	return lo + 1;
+}
+
+template<unsigned int H, unsigned int S>
+void
+WimshAllocTable<H, S>::merge (std::vector<Run>& v)
+{
+	unsigned int j = 0;
+	for ( unsigned int i = 1 ; i < v.size() ; i++ ) {
+		if ( v[j].match (v[i]) ) v[j].range_ += v[i].range_;
+		else                     v[++j] = v[i];
+	}
+	v.resize (j + 1);
+}
+
+template<unsigned int H, unsigned int S>
+void
+WimshAllocTable<H, S>::set (Field field,
+		unsigned int fstart, unsigned int frange,
+		unsigned int mstart, unsigned int mrange, unsigned int value)
+{
+	if ( WimaxDebug::trace ("WALC::set") ) fprintf (stderr,
+			"\tWALC::set\tfield %d fstart %d frange %d mstart %d mrange %d val %d\n",
+			field, fstart, frange, mstart, mrange, value);
+
+	const unsigned int mend = ( mstart + mrange < S ) ? mstart + mrange : S;
+	if ( mstart >= mend ) return;
+
+	for ( unsigned int f = 0 ; f < frange ; f++ ) {
+		std::vector<Run>& v = frame (fstart + f);
+
+		// splitting at mend does not move the runs before mstart
+		const unsigned int first = split (v, mstart);
+		const unsigned int last = split (v, mend);
+		for ( unsigned int i = first ; i < last ; i++ ) v[i].assign (field, value);
+		merge (v);
+	}
+}
+
+template<unsigned int H, unsigned int S>
+std::vector<typename WimshAllocTable<H, S>::Run>&
+WimshAllocTable<H, S>::frame (unsigned int f) const
+{
+	const unsigned int b = f % H;
+	const unsigned int abs = now_ + ( b + H - now_ % H ) % H;
+	std::vector<Run>& v = frames_[b];
+	if ( epoch_[b] == abs ) return v;
+
+	for ( unsigned int i = 0 ; i < v.size() ; i++ ) {
+		if ( v[i].service_ != keep_ ) v[i] = Run (v[i].start_, v[i].range_);
+		else                          v[i].uncoord_ = UINT_MAX;
+	}
+	merge (v);
+	epoch_[b] = abs;
+	return v;
+}
+
+#endif // __NS2_WIMSH_ALLOC_H
@@ -47,6 +47,12 @@ WimshFragmentationBuffer::newBurst (wimax::BurstProfile p, unsigned int size, un
 	// the size is automatically computed when adding PDUs
 	// the txtime is computed by the PHY layer
 
+	return resume (s);
+}
+
+bool
+WimshFragmentationBuffer::resume (unsigned int s)
+{
 	//
 	// if there is no pending PDU, return with success
 	//
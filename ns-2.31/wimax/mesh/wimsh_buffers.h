@@ -73,6 +73,15 @@ public:
 	  is returned to indicate that new PDUs cannot be added.
 	  */
 	bool newBurst (wimax::BurstProfile p, unsigned int size, unsigned int s);
+	//! Add the pending PDU of service class s, if any. True if there is still some room.
+	/*!
+	  This is used to fill the current burst with PDUs of a service
+	  class other than that of newBurst(). The pending PDU (or fragment
+	  thereof) must be added before any other PDU of the same class.
+	  */
+	bool resume (unsigned int s);
+	//! Add some bytes to the remaining size of the current burst.
+	void extend (unsigned int bytes) { size_ += bytes; }
 	/*
 	//! Add a MSH-DSCH_rtPS, if possible. True if entirely added.
 	//bool addDsch (WimshMshDsch* dsch);
@@ -28,42 +28,75 @@
  *
  */
 
-WimshBwManager::WimshBwManager (WimshMac* m) : mac_ (m), timer_ (this)
-{
-	// resize the vectors to the time horizon (in frames)
-	grants_.resize (HORIZON);
-	dst_.resize (HORIZON);
-	channel_.resize (HORIZON);
-	service_.resize (HORIZON);
-	src_.resize (HORIZON);
-	uncoordsch_.resize (HORIZON);
-
-	for ( unsigned int i = 0 ; i < HORIZON ; i++ ) {
-		// clear all the bits of the frame maps
-		grants_[i].reset();
-
-		// resize the channel and destination vectors
-		dst_[i].resize (MAX_SLOTS);
-		channel_[i].resize (MAX_SLOTS);
-		service_[i].resize (MAX_SLOTS);
-		src_[i].resize (MAX_SLOTS);
-		uncoordsch_[i].resize (MAX_SLOTS);
-
-		// set all channels to 0
-		for ( unsigned int j = 0 ; j < MAX_SLOTS ; j++ ) {
-			channel_[i][j]		= 0;
-			service_[i][j]		= 9;
-			dst_[i][j]			= UINT_MAX;
-			src_[i][j]			= UINT_MAX;
-			uncoordsch_[i][j]	= UINT_MAX;
-		}
-	}
+std::map<std::string, WimshBwManager::Snapshot> WimshBwManager::snapshots_;
 
+WimshBwManager::WimshBwManager (WimshMac* m) :
+	mac_ (m), timer_ (this), table_ (wimax::UGS)
+{
    // start the timer for the first time to expire at the beginning
    // of the first data subframe
    timer_.start (mac_->phyMib()->controlDuration());
 
 	lastSlot_ = 0;
+	coalesce_ = false;
+	record_ = 0;
+}
+
+WimshBwManager::~WimshBwManager ()
+{
+	if ( record_ ) fclose (record_);
+	closeSnapshot ();
+}
+
+int
+WimshBwManager::command (int argc, const char*const* argv)
+{
+	if ( argc == 2 && strcmp (argv[0], "coalesce") == 0 ) {
+		if ( strcmp (argv[1], "on") == 0 ) {
+			coalesce_ = true;
+		} else if ( strcmp (argv[1], "off") == 0 ) {
+			coalesce_ = false;
+		} else {
+			fprintf (stderr, "invalid coalesce '%s' command. "
+					"Choose either 'on' or 'off'\n", argv[1]);
+			return TCL_ERROR;
+		}
+		return TCL_OK;
+	} else if ( argc == 2 && strcmp (argv[0], "record") == 0 ) {
+		if ( record_ ) fclose (record_);
+		record_ = fopen (argv[1], "wb");
+		if ( ! record_ ) {
+			fprintf (stderr, "could not open file '%s' for writing\n", argv[1]);
+			return TCL_ERROR;
+		}
+		put (record_, RECORD_MAGIC, 4);
+		put (record_, RECORD_VERSION, 1);
+		put (record_, mac_->nodeId(), 4);
+		put (record_, mac_->phyMib()->slotPerFrame(), 2);
+		return TCL_OK;
+	} else if ( argc == 2 && strcmp (argv[0], "snapshot") == 0 ) {
+		closeSnapshot ();
+		std::map<std::string, Snapshot>::iterator it = snapshots_.find (argv[1]);
+		if ( it == snapshots_.end() ) {
+			Snapshot s;
+			s.file_ = fopen (argv[1], "wb");
+			s.users_ = 0;
+			s.frame_ = UINT_MAX;
+			if ( ! s.file_ ) {
+				fprintf (stderr, "could not open file '%s' for writing\n", argv[1]);
+				return TCL_ERROR;
+			}
+			put (s.file_, SNAPSHOT_MAGIC, 4);
+			put (s.file_, SNAPSHOT_VERSION, 1);
+			put (s.file_, mac_->phyMib()->slotPerFrame(), 2);
+			it = snapshots_.insert (std::make_pair (std::string (argv[1]), s)).first;
+		}
+		it->second.users_++;
+		snapshot_ = argv[1];
+		return TCL_OK;
+	}
+
+	return TCL_ERROR;
 }
 
 void
@@ -87,6 +120,10 @@ WimshBwManager::handle ()
 	unsigned int range = 0;   // minislot range of the next event
 	unsigned int service = wimax::N_SERV_CLASS;		// traffic service class
 	unsigned int undsch = UINT_MAX;
+	unsigned int slots[wimax::N_SERV_CLASS];	// minislots of each service class
+	bool merged = false;      // true if more than one service class (tx only)
+
+	for ( unsigned int s = 0 ; s < wimax::N_SERV_CLASS ; s++ ) slots[s] = 0;
 
 	// search for next frame to transmit requests (turn on bwmanager_frr flags)
 	// these frames are assigned at end of request procedure in bwmanager_frr
@@ -129,36 +166,52 @@ WimshBwManager::handle ()
 	 * When it's finished, 'range' represents a range of slots
 	 * [lastSlot_ - range, lastSlot_] with the same characteristics
 	 */
-	for ( ; lastSlot_ < N ; lastSlot_++ ) {
-		if ( range == 0 ) { // first run
-			status = grants_[F][lastSlot_]; 		// get this slot's direction (tx/rx)
-			undsch = uncoordsch_[F][lastSlot_];		// get uncoordDSCH reservation
-			if ( status == true ) { 				// if (tx)
-				dst = dst_[F][lastSlot_]; 				// get destination of slot
-				service = service_[F][lastSlot_]; } 	// get service for slot
-			channel = channel_[F][lastSlot_]; 		// get transmission channel
-			start = lastSlot_;
-			range = 1;
-			if ( WimaxDebug::trace("WBWM::handle") ) fprintf (stderr,
-					"%.9f WBWM::handle     [%d] 1st status %u dst %d serv %d src %d channel %d undsch %d slot %d\n",
-					NOW, mac_->nodeId(), status, dst_[F][lastSlot_], service_[F][lastSlot_], src_[F][lastSlot_],
-					channel_[F][lastSlot_], undsch, lastSlot_);
-		} else {
-//			if ( WimaxDebug::trace("WBWM::handle") ) fprintf (stderr,
-//					"%.9f WBWM::handle     [%d] grant %u dst %d service %d src %d channel %d undsch %u slot %d\n",
-//					NOW, mac_->nodeId(), grants_[F][lastSlot_]?1:0,dst_[F][lastSlot_], service_[F][lastSlot_],
-//					src_[F][lastSlot_], channel_[F][lastSlot_], uncoordsch_[F][lastSlot_], lastSlot_);
-
-			// Conditions: same channel, unDSCH, grant status,
-			// and 'direction=rx or (direction=tx & same dst & same service)'
-			if ( channel_[F][lastSlot_] == channel && uncoordsch_[F][lastSlot_] == undsch &&
-					grants_[F][lastSlot_] == status && (
-							( status == true && dst_[F][lastSlot_] == dst && service_[F][lastSlot_] == service )
+	if ( lastSlot_ < N ) {
+		const std::vector<Alloc::Run>& runs = table_.runs (F);
+		unsigned int r = table_.find (F, lastSlot_);
+
+		const Alloc::Run& first = runs[r];
+		status = first.tx_; 				// get this slot's direction (tx/rx)
+		undsch = first.uncoord_;			// get uncoordDSCH reservation
+		if ( status == true ) { 			// if (tx)
+			dst = first.dst_; 				// get destination of slot
+			service = first.service_; } 	// get service for slot
+		channel = first.channel_; 			// get transmission channel
+		start = lastSlot_;
+		if ( WimaxDebug::trace("WBWM::handle") ) fprintf (stderr,
+				"%.9f WBWM::handle     [%d] 1st status %u dst %d serv %d src %d channel %d undsch %d slot %d\n",
+				NOW, mac_->nodeId(), status, first.dst_, first.service_, first.src_,
+				first.channel_, undsch, lastSlot_);
+
+		// Conditions: same channel, unDSCH, grant status,
+		// and 'direction=rx or (direction=tx & same dst & same service)'
+		// with coalescing, the service class of tx runs may differ
+		unsigned int end = first.end();
+		if ( status == true && service < wimax::N_SERV_CLASS )
+			slots[service] = ( ( end < N ) ? end : N ) - lastSlot_;
+		for ( ++r ; r < runs.size() && end < N ; ++r ) {
+			const Alloc::Run& next = runs[r];
+			const bool mergeable = ( coalesce_ &&
+					service < wimax::N_SERV_CLASS && next.service_ < wimax::N_SERV_CLASS );
+			if ( next.channel_ == channel && next.uncoord_ == undsch &&
+					next.tx_ == status && (
+							( status == true && next.dst_ == dst &&
+							  ( next.service_ == service || mergeable ) )
 							|| ( status == false )
 							) )
-			{ ++range; }
+			{
+				end = next.end();
+				if ( status == true && next.service_ < wimax::N_SERV_CLASS ) {
+					slots[next.service_] += ( ( end < N ) ? end : N ) - next.start_;
+					if ( next.service_ != service ) merged = true;
+				}
+			}
 			else break;
 		}
+		if ( end > N ) end = N;
+
+		range = end - lastSlot_;
+		lastSlot_ = end;
 	}
 
 	if ( undsch != UINT_MAX ) { // if this slot range is marked for uncoordinated DSCH
@@ -177,7 +230,9 @@ WimshBwManager::handle ()
 //				"\ttransmitting range %d dst %d ch %d srv %d\n",
 //				range, dst, channel, service);
 		// set transmit mode on channel 0 towards dst
-		mac_->transmit (range, dst, channel, service);
+		// a burst coalesced from several service classes is sent as a whole
+		if ( merged ) mac_->transmit (range, dst, channel, slots);
+		else          mac_->transmit (range, dst, channel, service);
 	} else {
 //		if ( WimaxDebug::trace("WBWM::handle") ) fprintf(stderr,
 //				"\treceiving\n");
@@ -210,17 +265,164 @@ WimshBwManager::handle ()
 void
 WimshBwManager::invalidate (unsigned int F)
 {
-	for ( unsigned int i = 0 ; i < MAX_SLOTS ; i++ ) {
-		if ( service_[F][i] == wimax::UGS ) { } // keep UGS entries on the current frame
-		else {
-			channel_[F][i] = 0;
-			grants_[F][i]  = 0;
-			service_[F][i] = 9;
-			dst_[F][i]     = UINT_MAX;
-			src_[F][i]     = UINT_MAX;
+	if ( record_ ) record ();
+	if ( ! snapshot_.empty() ) snapshot ();
+
+	// the current frame becomes stale, and it will be reset on its
+	// next access (UGS entries are kept)
+	table_.advance (mac_->frame() + 1);
+}
+
+unsigned long
+WimshBwManager::memory ()
+{
+	unsigned long bytes = table_.memory () +
+		( startHorizon_.capacity() + nextFrame_.capacity() +
+		  unDschState_.capacity() ) * sizeof(std::vector<unsigned int>) +
+		rtpsDschFrame_.capacity() * sizeof(unsigned int);
+	for ( unsigned int ngh = 0 ; ngh < startHorizon_.size() ; ngh++ )
+		bytes += startHorizon_[ngh].capacity() * sizeof(unsigned int);
+	for ( unsigned int ngh = 0 ; ngh < nextFrame_.size() ; ngh++ )
+		bytes += nextFrame_[ngh].capacity() * sizeof(unsigned int);
+	for ( unsigned int ngh = 0 ; ngh < unDschState_.size() ; ngh++ )
+		bytes += unDschState_[ngh].capacity() * sizeof(unsigned int);
+	return bytes;
+}
+
+void
+WimshBwManager::disableRequests ()
+{
+	const unsigned int neighbors = mac_->nneighs();
+
+	startHorizon_.resize (neighbors);
+	nextFrame_.resize (neighbors);
+	unDschState_.resize (neighbors);
+	rtpsDschFrame_.resize (neighbors);
+	for ( unsigned int ngh = 0 ; ngh < neighbors ; ngh++ ) {
+		startHorizon_[ngh].resize (wimax::N_SERV_CLASS);
+		nextFrame_[ngh].resize (wimax::N_SERV_CLASS);
+		for ( unsigned int s = 0 ; s < wimax::N_SERV_CLASS ; s++ ) {
+			startHorizon_[ngh][s] = false;
+			nextFrame_[ngh][s] = UINT_MAX;
 		}
-		uncoordsch_[F][i] = UINT_MAX;
+		unDschState_[ngh].resize (HORIZON);
+		rtpsDschFrame_[ngh] = 0;
+	}
+}
+
+void
+WimshBwManager::record ()
+{
+	const std::vector<Alloc::Run>& runs = table_.runs (mac_->frame() % HORIZON);
+
+	// the uncoordinated MSH-DSCH opportunities are not recorded, hence
+	// the runs that only differ in them are merged
+	std::vector<Alloc::Run> v;
+	for ( unsigned int i = 0 ; i < runs.size() ; i++ ) {
+		Alloc::Run r = runs[i];
+		r.uncoord_ = UINT_MAX;
+		if ( ! v.empty() && v.back().match (r) ) v.back().range_ += r.range_;
+		else                                     v.push_back (r);
+	}
+
+	// frames in their default state are not recorded
+	if ( v.size() == 1 && v[0].match (Alloc::Run ()) ) return;
+
+	put (record_, mac_->frame(), 4);
+	put (record_, v.size(), 2);
+	for ( unsigned int i = 0 ; i < v.size() ; i++ ) {
+		put (record_, v[i].start_, 2);
+		put (record_, v[i].range_, 2);
+		put (record_, v[i].tx_ ? 1 : 0, 1);
+		put (record_, v[i].service_, 1);
+		put (record_, v[i].channel_, 1);
+		put (record_, v[i].tx_ ? v[i].dst_ : v[i].src_, 4);
+	}
+}
+
+void
+WimshBwManager::snapshot ()
+{
+	const unsigned int N = mac_->phyMib()->slotPerFrame();
+	const std::vector<Alloc::Run>& runs = table_.runs (mac_->frame() % HORIZON);
+
+	// keep only the attributes of each run of the frame that make up its
+	// state, then merge the adjacent runs with the same state
+	std::vector<Alloc::Run> v;
+	bool idle = true;
+	for ( unsigned int i = 0 ; i < runs.size() && runs[i].start_ < N ; i++ ) {
+		const Alloc::Run& r = runs[i];
+		Alloc::Run e (r.start_, ( r.end() < N ) ? r.range_ : N - r.start_);
+		e.channel_ = r.channel_;
+		e.service_ = r.service_;
+		if ( r.uncoord_ != UINT_MAX ) e.uncoord_ = r.uncoord_;
+		else if ( r.tx_ )             { e.tx_ = true; e.dst_ = r.dst_; }
+		else                          e.src_ = r.src_;
+		if ( e.uncoord_ != UINT_MAX || e.tx_ || e.src_ != UINT_MAX ) idle = false;
+
+		if ( ! v.empty() && v.back().match (e) ) v.back().range_ += e.range_;
+		else                                     v.push_back (e);
+	}
+
+	// the first manager of the stream to get here marks the frame
+	Snapshot& s = snapshots_[snapshot_];
+	FILE* file = s.file_;
+	if ( s.frame_ != mac_->frame() ) {
+		put (file, mac_->frame(), 4);
+		put (file, SNAPSHOT_MARKER, 4);
+		put (file, 0, 2);
+		s.frame_ = mac_->frame();
+	}
+
+	// idle frames are not appended
+	if ( idle ) return;
+
+	put (file, mac_->frame(), 4);
+	put (file, mac_->nodeId(), 4);
+	put (file, v.size(), 2);
+	for ( unsigned int i = 0 ; i < v.size() ; i++ ) {
+		const Alloc::Run& r = v[i];
+		const unsigned int state = ( r.uncoord_ != UINT_MAX ) ? SNAP_UNCOORD :
+		                           ( r.tx_ )                  ? SNAP_TX : SNAP_RX;
+		put (file, r.start_, 2);
+		put (file, r.range_, 2);
+		put (file, state, 1);
+		put (file, r.channel_, 1);
+		put (file, r.service_, 1);
+		put (file, ( state == SNAP_UNCOORD ) ? r.uncoord_ :
+		           ( state == SNAP_TX )      ? r.dst_ : r.src_, 4);
+	}
+}
+
+void
+WimshBwManager::closeSnapshot ()
+{
+	if ( snapshot_.empty() ) return;
+
+	std::map<std::string, Snapshot>::iterator it = snapshots_.find (snapshot_);
+	if ( --it->second.users_ == 0 ) {
+		fclose (it->second.file_);
+		snapshots_.erase (it);
+	}
+	snapshot_.clear ();
+}
+
+void
+WimshBwManager::put (FILE* file, unsigned int value, unsigned int n)
+{
+	for ( unsigned int i = 0 ; i < n ; i++ ) fputc ( ( value >> ( 8 * i ) ) & 0xff, file );
+}
+
+bool
+WimshBwManager::get (FILE* file, unsigned int& value, unsigned int n)
+{
+	value = 0;
+	for ( unsigned int i = 0 ; i < n ; i++ ) {
+		const int c = fgetc (file);
+		if ( c == EOF ) return false;
+		value |= (unsigned int) c << ( 8 * i );
 	}
+	return true;
 }
 
 void
@@ -238,7 +440,7 @@ WimshBwManager::printMiniSlots(void)
 
 		fprintf(stderr, "\t   dst:%3d:", 0);
 		for (unsigned nslot=0; nslot < N ; nslot++) {
-			fprintf(stderr, " %2d", dst_[F][nslot]);
+			fprintf(stderr, " %2d", table_.at (F, nslot).dst_);
 			if( ((nslot+1) % 35) == 0 && nslot != 139) fprintf(stderr,"\n\t       %3d:",nslot+1);
 		}
 
@@ -247,7 +449,8 @@ WimshBwManager::printMiniSlots(void)
 		fprintf(stderr, "\t   srv:%3d:", 0);
 		for (unsigned nslot=0; nslot < N ; nslot++) {
 
-			fprintf(stderr, " %c%1d", grants_[F][nslot]?'t':'r', service_[F][nslot]);
+			const Alloc::Run& run = table_.at (F, nslot);
+			fprintf(stderr, " %c%1d", run.tx_?'t':'r', run.service_);
 
 
 
@@ -279,7 +482,7 @@ WimshBwManagerDummy::command (int argc, const char*const* argv)
       return TCL_OK;
 	}
 
-	return TCL_ERROR;
+	return WimshBwManager::command (argc, argv);
 }
 
 void
@@ -301,19 +504,10 @@ WimshBwManagerDummy::recvMshDsch (WimshMshDsch* dsch)
 			// we assume that the persistence is not 'forever'
 			// we ignore cancellations (ie. persistence = 'cancel')
 
-			// for each frame in the persistence
-			for ( unsigned int f = 0 ;
-					f < WimshMshDsch::pers2frames (it->persistence_) ; f++ ) {
-				unsigned int F = ( it->frame_ + f ) % HORIZON;
-
-				// for each minislot into the range
-				for ( unsigned int s = 0 ; s < it->range_ ; s++ ) {
-					unsigned int S = s + it->start_;
-
-					grants_[F][S] = true;
-					dst_[F][S] = dsch->src();
-				}  // for each minislot into the range
-			} // for each frame in the persistence
+			// mark the range over each frame in the persistence
+			const unsigned int frange = WimshMshDsch::pers2frames (it->persistence_);
+			table_.set (Alloc::F_TX, it->frame_, frange, it->start_, it->range_, true);
+			table_.set (Alloc::F_DST, it->frame_, frange, it->start_, it->range_, dsch->src());
 		}
 	} // for each grant in the MSH-DSCH message
 }
@@ -345,3 +539,136 @@ WimshBwManagerDummy::schedule (WimshMshDsch* dsch, unsigned int dst)
 	}
 }
 
+/*
+ *
+ * class WimshBwManagerReplay
+ *
+ */
+
+WimshBwManagerReplay::WimshBwManagerReplay (WimshMac* m) :
+	WimshBwManagerDummy (m)
+{
+	replay_ = 0;
+	pending_ = UINT_MAX;
+	loaded_ = UINT_MAX;
+}
+
+WimshBwManagerReplay::~WimshBwManagerReplay ()
+{
+	if ( replay_ ) fclose (replay_);
+}
+
+int
+WimshBwManagerReplay::command (int argc, const char*const* argv)
+{
+	if ( argc == 2 && strcmp (argv[0], "replay") == 0 ) {
+		if ( replay_ ) fclose (replay_);
+		replay_ = fopen (argv[1], "rb");
+		if ( ! replay_ ) {
+			fprintf (stderr, "could not open file '%s' for reading\n", argv[1]);
+			return TCL_ERROR;
+		}
+
+		unsigned int magic, version, node, slots;
+		if ( ! get (replay_, magic, 4) || ! get (replay_, version, 1) ||
+				! get (replay_, node, 4) || ! get (replay_, slots, 2) ||
+				magic != RECORD_MAGIC || version != RECORD_VERSION ) {
+			fprintf (stderr, "file '%s' does not contain recorded "
+					"allocations\n", argv[1]);
+			return TCL_ERROR;
+		}
+		if ( node != mac_->nodeId() ||
+				slots != mac_->phyMib()->slotPerFrame() ) {
+			fprintf (stderr, "file '%s' was recorded at node %d with %d "
+					"minislots per frame, instead of node %d with %d\n",
+					argv[1], node, slots, mac_->nodeId(),
+					mac_->phyMib()->slotPerFrame());
+			return TCL_ERROR;
+		}
+
+		// the following frames are loaded at the end of each frame
+		loaded_ = UINT_MAX;
+		next ();
+		load (mac_->frame());
+		load (mac_->frame() + 1);
+		return TCL_OK;
+	}
+
+	return WimshBwManagerDummy::command (argc, argv);
+}
+
+void
+WimshBwManagerReplay::initialize ()
+{
+	disableRequests ();
+}
+
+void
+WimshBwManagerReplay::invalidate (unsigned int F)
+{
+	WimshBwManagerDummy::invalidate (F);
+
+	if ( replay_ ) load (mac_->frame() + 1);
+}
+
+void
+WimshBwManagerReplay::next ()
+{
+	pending_ = UINT_MAX;
+
+	unsigned int frame, n;
+	if ( ! get (replay_, frame, 4) || ! get (replay_, n, 2) ) return;
+
+	runs_.resize (n);
+	unsigned int end = 0;
+	for ( unsigned int i = 0 ; i < n ; i++ ) {
+		unsigned int start, range, tx, service, channel, peer;
+		if ( ! get (replay_, start, 2) || ! get (replay_, range, 2) ||
+				! get (replay_, tx, 1) || ! get (replay_, service, 1) ||
+				! get (replay_, channel, 1) || ! get (replay_, peer, 4) ||
+				start != end ) {
+			fprintf (stderr, "corrupted record of frame %d at node %d\n",
+					frame, mac_->nodeId());
+			return;
+		}
+		end = start + range;
+
+		Alloc::Run& r = runs_[i];
+		r = Alloc::Run (start, range);
+		r.tx_ = ( tx != 0 );
+		r.service_ = service;
+		r.channel_ = channel;
+		if ( r.tx_ ) r.dst_ = peer;
+		else         r.src_ = peer;
+	}
+
+	if ( end != MAX_SLOTS ) {
+		fprintf (stderr, "corrupted record of frame %d at node %d\n",
+				frame, mac_->nodeId());
+		return;
+	}
+
+	pending_ = frame;
+}
+
+void
+WimshBwManagerReplay::load (unsigned int f)
+{
+	// the record of f, if any, has already been consumed
+	if ( loaded_ != UINT_MAX && f <= loaded_ ) return;
+	loaded_ = f;
+
+	// skip the records of the frames already elapsed
+	while ( pending_ < f ) next ();
+
+	if ( pending_ == f ) {
+		table_.assign (f, runs_);
+		next ();
+	} else {
+		table_.assign (f, std::vector<Alloc::Run> (1, Alloc::Run ()));
+	}
+
+	if ( WimaxDebug::trace("WBWM::load") ) fprintf (stderr,
+			"%.9f WBWM::load       [%d] frame %d runs %d\n",
+			NOW, mac_->nodeId(), f, (int) table_.runs (f).size());
+}
@@ -22,11 +22,14 @@
 
 #include <wimax_common.h>
 #include <t_timers.h>
+#include <wimsh_alloc.h>
 
-#include <bitset>
+#include <map>
+#include <string>
 #include <vector>
 
 #include <math.h>
+#include <stdio.h>
 
 class WimshMac;
 class WimshMshDsch;
@@ -52,41 +55,34 @@ protected:
 	//! Timer to schedule bandwidth manager events.
 	TTimer<WimshBwManager> timer_;
 
-   /*! Array of bit maps representing granted minislots within frames.
-      When the minislot is not granted for transmission, the node
-	  moves to receive mode. The channel used for both reception and
-	  transmission is specified in the channel_ array.
-
-	  Note that there is the following (bad) trick. The elements in
-	  the channel_ array are initialized to 'zero' and those in the
-	  grants_ array to 'receive'. Therefore, whenever a node does not
-	  send a confirmation (ie. it does not use that slot for transmission)
-	  and does not receive a confirmation addressed to itself (ie. it does
-	  not receive from a neighbor in that slot) then the slot is
-	  automatically used for reception from the 'zero' channel, which is
-	  the control channel. This allows for uncoordinated scheduling to
-	  be implemented without any modification, *but* only works provided
-	  that the control channel used by the MAC is always 'zero'.
-
-     The F-th entry of this data structure is reset by handle(), where
-     F is the frame number (modulo HORIZON) of the current data frame
-     at the end of each frame.
-     */
-	std::vector< std::bitset<MAX_SLOTS> > grants_;
-	//! Array of vectors representing the grants' destinations.
-	std::vector< std::vector<WimaxNodeId> > dst_;
-	//! Array of vectors representing the grants' sources.
-	std::vector< std::vector<WimaxNodeId> > src_;
-	//! Array of vectors representing the channel identifiers.
-	std::vector< std::vector<unsigned int> > channel_;
-	//! Array of vectors representing the service class for each burst traffic.
-	std::vector< std::vector<unsigned char> > service_;
-	//! Array of vectors representing tx opportunities for uncoordinated MSH-DSCH.
-	std::vector< std::vector<WimaxNodeId> > uncoordsch_;
+	//! Allocation table type.
+	typedef WimshAllocTable<HORIZON, MAX_SLOTS> Alloc;
+
+	/*! Run-length encoded allocation of minislots within frames.
+	  For each minislot it stores whether it is granted for transmission
+	  (otherwise the node moves to receive mode), the destination,
+	  source, channel, service class and the destination of an
+	  uncoordinated MSH-DSCH, if any. See WimshAllocTable::Run for the
+	  trick used for uncoordinated scheduling.
+
+	  The entries of the current data frame become stale at the end
+	  of each frame, when handle() calls invalidate(), and they are
+	  reset on their next access.
+	  */
+	Alloc table_;
 
 	//! Next slot to be served.
 	unsigned int lastSlot_;
 
+	//! True if adjacent grants towards the same neighbor are sent as one burst.
+	/*!
+	  If true, handle() merges the consecutive transmit runs to the same
+	  destination over the same channel, even though they are granted
+	  to different service classes, so that a single PHY preamble
+	  is transmitted. Set via Tcl. Default = no.
+	  */
+	bool coalesce_;
+
 	// TODO: document the following four
 	//! turn on when able to transmit service class scheduling message
 	// (is initialized as true)
@@ -98,11 +94,72 @@ protected:
 	//!
 	std::vector<unsigned int> rtpsDschFrame_;
 
+	//! Binary file where the allocation of each frame is recorded, if any.
+	/*!
+	  The file starts with a header (RECORD_MAGIC, RECORD_VERSION, NodeID
+	  of this node, number of minislots per frame) followed by one record
+	  for each frame with at least one minislot not in its default state:
+	  the frame number, the number of runs and, for each run, the start,
+	  range, direction, service class, channel and peer (the destination
+	  if transmitting, the source otherwise). All fields are unsigned
+	  little-endian integers of 4 (magic, NodeID, frame number, peer),
+	  2 (number of minislots, number of runs, start, range) or 1 byte.
+	  The uncoordinated MSH-DSCH opportunities are not recorded.
+	  */
+	FILE* record_;
+
+	//! Magic number of a file of recorded allocations.
+	enum { RECORD_MAGIC = 0x52535357 };
+
+	//! Format version of a file of recorded allocations.
+	enum { RECORD_VERSION = 1 };
+
+	//! Stream of slot-map snapshots shared by the managers naming the same file.
+	struct Snapshot {
+		//! File handle.
+		FILE* file_;
+		//! Number of managers appending to this stream.
+		unsigned int users_;
+		//! Last frame marked in this stream, or UINT_MAX if none.
+		unsigned int frame_;
+	};
+
+	//! Open snapshot streams, by file name.
+	static std::map<std::string, Snapshot> snapshots_;
+
+	//! Name of the stream where the slot map of each frame is appended, if any.
+	/*!
+	  The stream starts with a header (SNAPSHOT_MAGIC, SNAPSHOT_VERSION,
+	  number of minislots per frame) followed, for each frame, by a marker
+	  record (the frame number, SNAPSHOT_MARKER, zero runs), so that idle
+	  frames are counted as well, and by one record for each node with at
+	  least one minislot not idle: the frame number, the
+	  NodeID, the number of runs and, for each run within the frame, the
+	  start, range, state (SNAP_RX, SNAP_TX or SNAP_UNCOORD), channel,
+	  service class and peer (the destination when transmitting data or
+	  an uncoordinated MSH-DSCH, the source when receiving). Fields are
+	  encoded as in the file of recorded allocations. Several nodes may
+	  append to the same stream, so that it covers the whole network.
+	  */
+	std::string snapshot_;
+
+	//! Magic number of a stream of slot-map snapshots.
+	enum { SNAPSHOT_MAGIC = 0x504e5357 };
+
+	//! Format version of a stream of slot-map snapshots.
+	enum { SNAPSHOT_VERSION = 2 };
+
+	//! NodeID of the record that marks the start of each frame in a snapshot stream.
+	enum { SNAPSHOT_MARKER = 0xffffffff };
+
+	//! State of a minislot in a snapshot.
+	enum SnapshotState { SNAP_RX = 0, SNAP_TX, SNAP_UNCOORD };
+
 public:
 	//! Create an empty bandwidth manager.
 	WimshBwManager (WimshMac* m);
-	//! Do nothing.
-	virtual ~WimshBwManager () { }
+	//! Close the file of recorded allocations and the snapshot stream, if any.
+	virtual ~WimshBwManager ();
 
 	//! Get an MSH-DSCH message from a neighbor, which is not deallocated.
 	virtual void recvMshDsch (WimshMshDsch* dsch) = 0;
@@ -122,6 +179,9 @@ public:
 	//! Print the minislot status for this node
 	virtual void printMiniSlots(void);
 
+	//! Return the number of bytes allocated by the bandwidth manager.
+	virtual unsigned long memory ();
+
 	//! Indicate some additional backlog of an end-to-end flow.
 	virtual void backlog (WimaxNodeId src, WimaxNodeId dst, unsigned char prio,
 			WimaxNodeId nexthop, unsigned int bytes ) = 0;
@@ -136,8 +196,26 @@ public:
 	//! We sent out some data on a link (i.e. negative backlog).
 	virtual void sent (WimaxNodeId nexthop, unsigned int bytes, unsigned int service_class) = 0;
 
+	//! Some bytes granted to a service class on a link were not used by it.
+	/*!
+	  Called by the MAC layer when the queue of the service class is empty
+	  at transmission time. Do nothing by default.
+	  */
+	virtual void unused (WimaxNodeId nexthop, unsigned int bytes, unsigned int service_class) { }
+
 	//! Tcl interface from the MAC layer.
-	virtual int command (int argc, const char*const* argv) = 0;
+	/*!
+	  Tcl commands:
+	  - $mac bwmanager coalesce [on|off]\n
+	    Send adjacent grants of different service classes to the same
+	    neighbor over the same channel as a single burst.
+	  - $mac bwmanager record file\n
+	    Record the final allocation of every frame into a binary file.
+	  - $mac bwmanager snapshot file\n
+	    Append the slot map of every frame to a binary stream, which can
+	    be shared by all the nodes.
+	  */
+	virtual int command (int argc, const char*const* argv);
 
 	//! TODO: Documentation
 	virtual void searchTXslot (unsigned int ndx, unsigned int reqState) = 0;
@@ -153,39 +231,32 @@ protected:
 	  */
 	virtual void invalidate (unsigned int F);
 
-	//! Utility function to set a range of elements to a given value.
-	template<typename T, typename V>
-	void setSlots ( T& map,
-			unsigned int fstart, unsigned int frange,
-			unsigned int mstart, unsigned int mrange, const V& value);
-};
+	//! Resize the request data structures so that requests are never sent.
+	/*!
+	  Used by the bandwidth managers that do not run the distributed
+	  request/grant procedure.
+	  */
+	void disableRequests ();
+
+	//! Write an unsigned integer into a file as n little-endian bytes.
+	static void put (FILE* file, unsigned int value, unsigned int n);
+
+	//! Read an unsigned integer of n little-endian bytes from a file.
+	/*!
+	  Return false if the end of the file is reached before.
+	  */
+	static bool get (FILE* file, unsigned int& value, unsigned int n);
+
+private:
+	//! Append the allocation of the current frame to the record file.
+	void record ();
+
+	//! Append the slot map of the current frame to the snapshot stream.
+	void snapshot ();
 
-template<typename T, typename V>
-void
-WimshBwManager::setSlots (
-      T& map,
-      unsigned int fstart, unsigned int frange,
-      unsigned int mstart, unsigned int mrange, const V& value)
-{
-	// TODO: implement debugging
-	if ( WimaxDebug::trace ("WBWM::setSlots" ) )
-		fprintf (stderr,
-			"\tWBWM::setSlots\tfstart %d frange %d mstart %d mrange %d val %d\n",
-			fstart, frange, mstart, mrange, value);
-
-	// for each frame
-	for ( unsigned int f = 0 ; f < frange ; f++ ) {
-		unsigned int F = ( fstart + f ) % HORIZON;
-
-		// for each minislot
-		for ( unsigned int s = 0 ; s < mrange ; s++ ) {
-			unsigned int S = mstart + s;
-
-			// mark the minislot
-			map[F][S] = value;
-		}
-	}
-}
+	//! Stop appending to the snapshot stream, and close it if not shared.
+	void closeSnapshot ();
+};
 
 /*
  *
@@ -243,6 +314,11 @@ public:
 	void sent (WimaxNodeId nexthop, unsigned int bytes, unsigned int service_class) { }
 
 	//! Tcl interface from the MAC layer.
+	/*!
+	  Tcl commands:
+	  - $mac bwmanager static node start range\n
+	    Grant the given range of minislots to a neighbor in every frame.
+	  */
 	int command (int argc, const char*const* argv);
 
 	void searchTXslot (unsigned int ndx, unsigned int reqState) { }
@@ -259,4 +335,73 @@ private:
 		alloc_.push_back (AllocationDesc (node, start, range)); }
 };
 
+/*
+ *
+ * class WimshBwManagerReplay
+ *
+ */
+
+//! Bandwidth manager replaying the allocations recorded by another one.
+/*!
+  The allocation of each frame is read from a file written via the
+  'record' command of any bandwidth manager, in the same scenario, so
+  that the data plane can be simulated again, with the same schedule,
+  without running the distributed request/grant procedure.
+
+  Frames not found in the file are left in their default state (ie.
+  receive from the control channel). MSH-DSCH messages are still
+  transmitted, but they carry no requests, grants or availabilities.
+  */
+class WimshBwManagerReplay : public WimshBwManagerDummy {
+	//! File of the recorded allocations. Set via Tcl.
+	FILE* replay_;
+
+	//! Frame number of the next record, or UINT_MAX if there are none left.
+	unsigned int pending_;
+
+	//! Runs of the next record.
+	std::vector<Alloc::Run> runs_;
+
+	//! Last frame loaded, or UINT_MAX if none.
+	unsigned int loaded_;
+
+public:
+	//! Create an empty bandwidth manager.
+	WimshBwManagerReplay (WimshMac* m);
+	//! Close the file of the recorded allocations, if any.
+	~WimshBwManagerReplay ();
+
+	//! Do nothing: allocations are read from file.
+	void recvMshDsch (WimshMshDsch* dsch) { }
+
+	//! Do nothing: allocations are read from file.
+	void schedule (WimshMshDsch* dsch, unsigned int ndx) { }
+
+	//! Resize the internal data structures.
+	void initialize ();
+
+	//! Return the number of bytes allocated by the bandwidth manager.
+	unsigned long memory () {
+		return WimshBwManagerDummy::memory () + runs_.capacity() * sizeof(Alloc::Run); }
+
+	//! Tcl interface from the MAC layer.
+	/*!
+	  Tcl commands:
+	  - $mac bwmanager replay file\n
+	    Read the allocations from a file recorded at this node.
+	  */
+	int command (int argc, const char*const* argv);
+
+protected:
+	//! Invalidate frame F, then load the next one.
+	void invalidate (unsigned int F);
+
+private:
+	//! Read the next record, if any.
+	void next ();
+
+	//! Load the allocation of frame f from the file, unless already loaded.
+	void load (unsigned int f);
+};
+
 #endif // __NS2_WIMSH_BW_MANAGER_H
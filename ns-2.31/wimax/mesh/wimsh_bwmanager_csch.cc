@@ -0,0 +1,265 @@
+/*
+ *  Copyright (C) 2007 Dip. Ing. dell'Informazione, University of Pisa, Italy
+ *  http://info.iet.unipi.it/~cng/ns2mesh80216/
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA, USA
+ */
+
+#include <wimsh_bwmanager_csch.h>
+
+#include <wimsh_mac.h>
+#include <wimsh_topology.h>
+#include <wimsh_scheduler.h>
+
+#include <algorithm>
+
+#include <math.h>
+#include <stat.h>
+
+/*
+ *
+ * class WimshBwManagerCentral
+ *
+ */
+
+std::map<WimaxNodeId, WimshBwManagerCentral*> WimshBwManagerCentral::nodes_;
+
+WimshBwManagerCentral::WimshBwManagerCentral (WimshMac* m) :
+	WimshBwManager (m)
+{
+	gateway_  = false;
+	period_   = 8;
+	hopDelay_ = 1;
+	depth_    = 0;
+}
+
+WimshBwManagerCentral::~WimshBwManagerCentral ()
+{
+	std::map<WimaxNodeId, WimshBwManagerCentral*>::iterator it =
+		nodes_.find (mac_->nodeId());
+	if ( it != nodes_.end() && it->second == this ) nodes_.erase (it);
+}
+
+int
+WimshBwManagerCentral::command (int argc, const char*const* argv)
+{
+	if ( argc == 1 && strcmp (argv[0], "gateway") == 0 ) {
+		gateway_ = true;
+		return TCL_OK;
+	} else if ( argc == 2 && strcmp (argv[0], "period") == 0 ) {
+		const int period = atoi (argv[1]);
+		if ( period <= 0 || period >= HORIZON ) {
+			fprintf (stderr, "invalid period '%s'. Choose a number "
+					"of frames in [1, %d]\n", argv[1], HORIZON - 1);
+			return TCL_ERROR;
+		}
+		period_ = period;
+		return TCL_OK;
+	} else if ( argc == 2 && strcmp (argv[0], "hop-delay") == 0 ) {
+		const int delay = atoi (argv[1]);
+		if ( delay < 0 || delay >= HORIZON ) {
+			fprintf (stderr, "invalid hop-delay '%s'. Choose a number "
+					"of frames in [0, %d]\n", argv[1], HORIZON - 1);
+			return TCL_ERROR;
+		}
+		hopDelay_ = delay;
+		return TCL_OK;
+	}
+
+	return WimshBwManager::command (argc, argv);
+}
+
+void
+WimshBwManagerCentral::initialize ()
+{
+	if ( mac_->nchannels() > 1 ) {
+		fprintf (stderr, "the centralized bandwidth manager supports "
+				"a single channel only, not %d\n", mac_->nchannels());
+		abort ();
+	}
+
+	// the distributed request/grant procedure is never triggered
+	disableRequests ();
+
+	nodes_[mac_->nodeId()] = this;
+}
+
+void
+WimshBwManagerCentral::invalidate (unsigned int F)
+{
+	if ( gateway_ && mac_->frame() % period_ == 0 ) compute ();
+
+	WimshBwManager::invalidate (F);
+}
+
+unsigned int
+WimshBwManagerCentral::demand (unsigned int ndx, unsigned int s)
+{
+	WimshScheduler* sched = mac_->scheduler();
+
+	// bytes per frame at the estimated rate of the service class
+	const double rate = sched->cbrQuocient (ndx, s);
+	unsigned int bytes =
+		(unsigned int) ceil (rate * mac_->phyMib()->frameDuration() / 8);
+
+	// or enough to drain the current backlog within one schedule; with
+	// a single queue per neighbor, the backlog is all counted as BE
+	const unsigned int queued = ( sched->perService () || s == wimax::BE ) ?
+		sched->neighbor (ndx, s) : 0;
+	const unsigned int backlog = ( queued + period_ - 1 ) / period_;
+	if ( backlog > bytes ) bytes = backlog;
+
+	return mac_->bytes2slots (ndx, bytes, true);
+}
+
+bool
+WimshBwManagerCentral::conflict (const Assignment& a,
+		WimaxNodeId src, WimaxNodeId dst)
+{
+	// a node can neither transmit and receive, nor serve two links, at once
+	if ( a.src_ == src || a.src_ == dst || a.dst_ == src || a.dst_ == dst )
+		return true;
+
+	return mac_->topology()->interfere (a.src_, a.dst_, src, dst);
+}
+
+unsigned int
+WimshBwManagerCentral::depth ()
+{
+	if ( depth_ > 0 ) return depth_;
+
+	// the n-hop neighbors are those exactly n hops away
+	WimshTopology* topo = mac_->topology();
+	for ( unsigned int n = 1 ; n < topo->numNodes() ; n++ ) {
+		std::vector<WimaxNodeId> neigh;
+		topo->neighbors (mac_->nodeId(), neigh, n);
+		if ( neigh.empty() ) break;
+		depth_ = n;
+	}
+	return depth_;
+}
+
+void
+WimshBwManagerCentral::compute ()
+{
+	const unsigned int N = mac_->phyMib()->slotPerFrame();
+
+	// the demands go up to the gateway, then the schedule goes down
+	const unsigned int delay = 1 + 2 * depth () * hopDelay_;
+	if ( delay + period_ > HORIZON ) {
+		fprintf (stderr, "the schedule of %d frames cannot be activated "
+				"%d frames in advance, beyond the horizon of %d frames\n",
+				period_, delay, HORIZON);
+		abort ();
+	}
+	const unsigned int frame = mac_->frame() + delay;
+
+	// collect the demand of every link and service class
+	std::vector<Demand> demands;
+	std::map<WimaxNodeId, WimshBwManagerCentral*>::iterator it;
+	for ( it = nodes_.begin() ; it != nodes_.end() ; ++it ) {
+		WimshBwManagerCentral* m = it->second;
+		for ( unsigned int ndx = 0 ; ndx < m->mac_->nneighs() ; ndx++ ) {
+			for ( unsigned int s = 0 ; s < wimax::N_SERV_CLASS ; s++ ) {
+				const unsigned int slots = m->demand (ndx, s);
+				if ( slots > 0 ) demands.push_back (
+						Demand (it->first, m->mac_->ndx2neigh (ndx), s, slots));
+			}
+		}
+	}
+	std::sort (demands.begin(), demands.end());
+
+	// give each demand the first range of minislots not used by any
+	// conflicting link already served, or the longest one if none fits
+	std::vector<Assignment> sched;
+	unsigned int assigned = 0;
+	unsigned int unserved = 0;
+	for ( unsigned int d = 0 ; d < demands.size() ; d++ ) {
+		const Demand& x = demands[d];
+
+		Alloc::Mask busy;
+		for ( unsigned int i = 0 ; i < sched.size() ; i++ )
+			if ( conflict (sched[i], x.src_, x.dst_) )
+				busy.set (sched[i].start_, sched[i].range_, true);
+
+		unsigned int range = ( x.slots_ < N ) ? x.slots_ : N;
+		unsigned int start = busy.findZeroRun (range, 0, N);
+		if ( start >= N ) {
+			range = 0;
+			for ( unsigned int s = busy.firstZero (0, N) ; s < N ; ) {
+				const unsigned int len = busy.zeroRun (s, N);
+				if ( len > range ) { start = s; range = len; }
+				s = busy.firstZero (s + len, N);
+			}
+		}
+
+		unserved += x.slots_ - range;
+		if ( range == 0 ) continue;
+
+		Assignment a;
+		a.src_ = x.src_;
+		a.dst_ = x.dst_;
+		a.service_ = x.service_;
+		a.start_ = start;
+		a.range_ = range;
+		sched.push_back (a);
+		assigned += range;
+
+		if ( WimaxDebug::trace("WBWM::compute") ) fprintf (stderr,
+				"\tassigning: src %d dst %d serv %d start %d range %d (demand %d)\n",
+				a.src_, a.dst_, a.service_, a.start_, a.range_, x.slots_);
+	}
+
+	// distribute the schedule to all the nodes
+	for ( it = nodes_.begin() ; it != nodes_.end() ; ++it )
+		it->second->clear (frame);
+	for ( unsigned int i = 0 ; i < sched.size() ; i++ ) {
+		if ( nodes_.count (sched[i].src_) == 1 ) nodes_[sched[i].src_]->apply (sched[i], frame);
+		if ( nodes_.count (sched[i].dst_) == 1 ) nodes_[sched[i].dst_]->apply (sched[i], frame);
+	}
+
+	if ( WimaxDebug::trace("WBWM::compute") ) fprintf (stderr,
+			"%.9f WBWM::compute    [%d] frames %d-%d demands %d links %d\n",
+			NOW, mac_->nodeId(), frame, frame + period_ - 1,
+			(int) demands.size(), (int) sched.size());
+
+	// average number of links active in each minislot
+	Stat::put ("wimsh_csch_reuse", mac_->index(), (double) assigned / N);
+	Stat::put ("wimsh_csch_unserved", mac_->index(), unserved);
+}
+
+void
+WimshBwManagerCentral::clear (unsigned int frame)
+{
+	const unsigned int N = mac_->phyMib()->slotPerFrame();
+
+	table_.set (Alloc::F_TX, frame, period_, 0, N, false);
+	table_.set (Alloc::F_DST, frame, period_, 0, N, UINT_MAX);
+	table_.set (Alloc::F_SRC, frame, period_, 0, N, UINT_MAX);
+	table_.set (Alloc::F_CHANNEL, frame, period_, 0, N, 0);
+	table_.set (Alloc::F_SERVICE, frame, period_, 0, N, Alloc::NO_SERVICE);
+}
+
+void
+WimshBwManagerCentral::apply (const Assignment& a, unsigned int frame)
+{
+	if ( a.src_ == mac_->nodeId() ) {
+		table_.set (Alloc::F_TX, frame, period_, a.start_, a.range_, true);
+		table_.set (Alloc::F_DST, frame, period_, a.start_, a.range_, a.dst_);
+		table_.set (Alloc::F_SERVICE, frame, period_, a.start_, a.range_, a.service_);
+	} else {
+		table_.set (Alloc::F_SRC, frame, period_, a.start_, a.range_, a.src_);
+	}
+}
@@ -0,0 +1,172 @@
+/*
+ *  Copyright (C) 2007 Dip. Ing. dell'Informazione, University of Pisa, Italy
+ *  http://info.iet.unipi.it/~cng/ns2mesh80216/
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA, USA
+ */
+
+#ifndef __NS2_WIMSH_BW_MANAGER_CSCH_H
+#define __NS2_WIMSH_BW_MANAGER_CSCH_H
+
+#include <wimsh_bwmanager.h>
+
+#include <map>
+#include <vector>
+
+/*
+ *
+ * class WimshBwManagerCentral
+ *
+ */
+
+//! Centralized bandwidth manager, in the style of MSH-CSCH. Single channel only.
+/*!
+  One node, the gateway, collects the demand of every link of the
+  network, for each service class, and computes a conflict-free
+  assignment of minislots, which is then distributed to all the nodes.
+  Each assignment covers period_ frames.
+
+  Minislots are assigned by greedy packing over the conflict graph of
+  the topology: the demands are sorted by decreasing service class and
+  then by decreasing size, and each of them is given the first range of
+  minislots that is not used by any conflicting link already served
+  (or the longest one, if none is large enough). Links that do not
+  conflict can thus reuse the same minislots.
+
+  MSH-CSCH messages are not actually exchanged: all the managers share
+  a static registry, and the time needed to collect the demands up the
+  routing tree and distribute the schedule down is modeled by activating
+  each schedule 1 + 2 * D * hopDelay_ frames after it is computed, where
+  D is the largest distance, in hops, of a node from the gateway, and
+  the schedule cannot be used in the frame in which it is computed.
+
+  MSH-DSCH messages are still transmitted, but they carry no requests,
+  grants or availabilities.
+  */
+class WimshBwManagerCentral : public WimshBwManager {
+	//! Demand of a link for a service class, as collected by the gateway.
+	struct Demand {
+		//! Transmitter.
+		WimaxNodeId src_;
+		//! Receiver.
+		WimaxNodeId dst_;
+		//! Service class.
+		unsigned char service_;
+		//! Number of minislots per frame.
+		unsigned int slots_;
+		//! Create a demand descriptor.
+		Demand (WimaxNodeId src, WimaxNodeId dst, unsigned char s, unsigned int slots) :
+			src_ (src), dst_ (dst), service_ (s), slots_ (slots) { }
+		//! Higher service classes first, then larger demands.
+		bool operator< (const Demand& x) const {
+			return ( service_ != x.service_ ) ? ( service_ > x.service_ )
+			                                  : ( slots_ > x.slots_ ); }
+	};
+
+	//! Range of minislots assigned to a link for a service class.
+	struct Assignment {
+		//! Transmitter.
+		WimaxNodeId src_;
+		//! Receiver.
+		WimaxNodeId dst_;
+		//! Service class.
+		unsigned char service_;
+		//! First minislot.
+		unsigned int start_;
+		//! Number of minislots.
+		unsigned int range_;
+	};
+
+	//! Bandwidth managers of all the nodes, by NodeID.
+	static std::map<WimaxNodeId, WimshBwManagerCentral*> nodes_;
+
+	//! True if this node computes the schedule. Set via Tcl. Default = no.
+	bool gateway_;
+
+	//! Number of frames covered by each schedule. Set via Tcl. Default = 8.
+	unsigned int period_;
+
+	//! Number of frames to relay MSH-CSCH messages by one hop. Set via Tcl. Default = 1.
+	unsigned int hopDelay_;
+
+	//! Largest distance of a node from this one, in hops. Zero until computed.
+	unsigned int depth_;
+
+public:
+	//! Create an empty bandwidth manager.
+	WimshBwManagerCentral (WimshMac* m);
+	//! Remove this manager from the registry.
+	~WimshBwManagerCentral ();
+
+	//! Do nothing: schedules are not carried by MSH-DSCH messages.
+	void recvMshDsch (WimshMshDsch* dsch) { }
+
+	//! Do nothing: schedules are not carried by MSH-DSCH messages.
+	void schedule (WimshMshDsch* dsch, unsigned int ndx) { }
+
+	//! Resize the internal data structures and join the registry.
+	void initialize ();
+
+	//! Do nothing: the demand is read from the packet scheduler.
+	void backlog (WimaxNodeId, WimaxNodeId, unsigned char,
+			WimaxNodeId, unsigned int) { }
+	//! Do nothing: the demand is read from the packet scheduler.
+	void backlog (WimaxNodeId nexthop, unsigned int bytes, unsigned int service ) { }
+	//! Do nothing.
+	void received (WimaxNodeId src, WimaxNodeId dst, unsigned char,
+			WimaxNodeId source, unsigned int bytes) { }
+	//! Do nothing: the demand is read from the packet scheduler.
+	void sent (WimaxNodeId nexthop, unsigned int bytes, unsigned int service_class) { }
+
+	//! Tcl interface from the MAC layer.
+	/*!
+	  Tcl commands:
+	  - $mac bwmanager gateway\n
+	    Compute the schedule of the whole network at this node.
+	  - $mac bwmanager period x\n
+	    Set the number of frames covered by each schedule to x.
+	  - $mac bwmanager hop-delay x\n
+	    Set the number of frames to relay an MSH-CSCH message by one hop to x.
+	  */
+	int command (int argc, const char*const* argv);
+
+	//! Do nothing: there are no uncoordinated MSH-DSCH messages.
+	void searchTXslot (unsigned int ndx, unsigned int reqState) { }
+
+protected:
+	//! Compute a new schedule at the gateway, then invalidate frame F.
+	void invalidate (unsigned int F);
+
+private:
+	//! Return the demand towards neighbor ndx for service s, in minislots per frame.
+	unsigned int demand (unsigned int ndx, unsigned int s);
+
+	//! Collect the demands, pack them and distribute the schedule.
+	void compute ();
+
+	//! Clear the allocation of frames [frame, frame + period_[.
+	void clear (unsigned int frame);
+
+	//! Set an assignment over frames [frame, frame + period_[.
+	void apply (const Assignment& a, unsigned int frame);
+
+	//! Return true if the link from src to dst cannot be active along with a.
+	bool conflict (const Assignment& a, WimaxNodeId src, WimaxNodeId dst);
+
+	//! Return the largest distance of a node from this one, in hops.
+	unsigned int depth ();
+};
+
+#endif // __NS2_WIMSH_BW_MANAGER_CSCH_H
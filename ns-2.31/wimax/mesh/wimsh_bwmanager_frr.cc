@@ -28,25 +28,11 @@
 #include <random.h>
 #include <stat.h>
 
-WimshBwManagerFairRR::WimshBwManagerFairRR (WimshMac* m) :
+template<unsigned int S>
+WimshBwManagerFairRR<S>::WimshBwManagerFairRR (WimshMac* m) :
 	WimshBwManager (m), wm_ (m)
 {
-	// resize the unavailabilities to receive of this node, confirmed or not
-	busy_.resize (HORIZON);
-	busy_UGS_.resize (HORIZON);
-	busy_NRTPS_.resize (HORIZON);
-	unconfirmedSlots_.resize (HORIZON);
-	unconfirmedSlots_UGS_.resize (HORIZON);
-	unconfirmedSlots_NRTPS_.resize (HORIZON);
-
-	for ( unsigned int i = 0 ; i < HORIZON ; i++ ) {
-		// clear all the bits of the busy_ and unconfirmedSlots_ bitmap
-		busy_[i].reset();
-		busy_UGS_[i].reset();
-		unconfirmedSlots_[i].reset();
-		unconfirmedSlots_UGS_[i].reset();
-	}
-
+	// the slot-state engine is allocated by initialize()
 	regrantOffset_         = 1;
 	regrantDuration_       = 1;
 	avlAdvertise_          = true;
@@ -56,6 +42,12 @@ WimshBwManagerFairRR::WimshBwManagerFairRR (WimshMac* m) :
 	fairRegrant_           = true;
 	deficitOverflow_       = false;
 	grantFitRandomChannel_ = false;
+	grantFitLeastLoaded_   = false;
+	grantFitPlacement_     = FIT_FIRST;
+	grantFitNext_          = 0;
+	grantStartFixed_       = 0;
+	grantStartMargin_      = 2;
+	rtpsDeadline_          = false;
 	sameRegrantHorizon_    = false;
 	maxDeficit_            = 0;
 	maxBacklog_            = 0;
@@ -66,8 +58,9 @@ WimshBwManagerFairRR::WimshBwManagerFairRR (WimshMac* m) :
 	nrtpsMinSlots_		   = 0;
 }
 
+template<unsigned int S>
 int
-WimshBwManagerFairRR::command (int argc, const char*const* argv)
+WimshBwManagerFairRR<S>::command (int argc, const char*const* argv)
 {
 	if ( argc == 2 && strcmp (argv[0], "availabilities") == 0 ) {
 		if ( strcmp (argv[1], "on") == 0 ) {
@@ -183,8 +176,27 @@ WimshBwManagerFairRR::command (int argc, const char*const* argv)
 		if ( strcmp (argv[1], "channel" ) == 0 ) {
 			if ( strcmp (argv[2], "random") == 0 ) {
 				grantFitRandomChannel_ = true;
+				grantFitLeastLoaded_ = false;
 			} else if ( strcmp (argv[2], "first") == 0 ) {
 				grantFitRandomChannel_ = false;
+				grantFitLeastLoaded_ = false;
+			} else if ( strcmp (argv[2], "least-loaded") == 0 ) {
+				grantFitRandomChannel_ = false;
+				grantFitLeastLoaded_ = true;
+			}
+		} else if ( strcmp (argv[1], "placement" ) == 0 ) {
+			if ( strcmp (argv[2], "first") == 0 ) {
+				grantFitPlacement_ = FIT_FIRST;
+			} else if ( strcmp (argv[2], "best") == 0 ) {
+				grantFitPlacement_ = FIT_BEST;
+			} else if ( strcmp (argv[2], "next") == 0 ) {
+				grantFitPlacement_ = FIT_NEXT;
+			} else if ( strcmp (argv[2], "end") == 0 ) {
+				grantFitPlacement_ = FIT_END;
+			} else {
+				fprintf (stderr, "unknown grant-fit placement '%s'. "
+						"Choose 'first', 'best', 'next' or 'end'\n", argv[2]);
+				return TCL_ERROR;
 			}
 		} else {
 			fprintf (stderr, "unknown grant-fit specifier '%s %s'\n",
@@ -192,18 +204,61 @@ WimshBwManagerFairRR::command (int argc, const char*const* argv)
 			return TCL_ERROR;
 		}
 		return TCL_OK;
+	} else if ( argc == 2 && strcmp (argv[0], "grant-start") == 0 ) {
+		if ( strcmp (argv[1], "adaptive") == 0 ) {
+			grantStartFixed_ = 0;
+		} else {
+			const int offset = atoi (argv[1]);
+			if ( offset <= 0 || offset >= HORIZON ) {
+				fprintf (stderr, "invalid grant-start '%s'. Choose either "
+						"'adaptive' or a number of frames in [1, %d]\n",
+						argv[1], HORIZON - 1);
+				return TCL_ERROR;
+			}
+			grantStartFixed_ = offset;
+		}
+		return TCL_OK;
+	} else if ( argc == 2 && strcmp (argv[0], "grant-start-margin") == 0 ) {
+		const int margin = atoi (argv[1]);
+		if ( margin <= 0 || margin > HORIZON / 4 ) {
+			fprintf (stderr, "invalid grant-start-margin '%s'. Choose "
+					"a number of frames in [1, %d]\n", argv[1], HORIZON / 4);
+			return TCL_ERROR;
+		}
+		grantStartMargin_ = margin;
+		return TCL_OK;
+	} else if ( argc == 2 && strcmp (argv[0], "rtps-deadline") == 0 ) {
+		if ( strcmp (argv[1], "on") == 0 ) {
+			rtpsDeadline_ = true;
+		} else if ( strcmp (argv[1], "off") == 0 ) {
+			rtpsDeadline_ = false;
+		} else {
+			fprintf (stderr, "invalid rtps-deadline '%s' command. "
+					"Choose either 'on' or 'off'\n", argv[1]);
+			return TCL_ERROR;
+		}
+		return TCL_OK;
 	} else if ( strcmp (argv[0], "wm") == 0 ) {
 		return wm_.command (argc - 1, argv + 1);
 	}
 
-	return TCL_ERROR;
+	return WimshBwManager::command (argc, argv);
 }
 
+template<unsigned int S>
 void
-WimshBwManagerFairRR::initialize ()
+WimshBwManagerFairRR<S>::initialize ()
 {
 	const unsigned int neighbors = mac_->nneighs();
 
+	// the bitmaps must be able to hold all the minislots of a frame
+	if ( mac_->phyMib()->slotPerFrame() > S ) {
+		fprintf (stderr, "bandwidth manager with room for %d minislots, "
+				"but the PHY has %d minislots per frame\n",
+				S, mac_->phyMib()->slotPerFrame());
+		abort ();
+	}
+
 	// resize and clear the bw request/grant data structure for each service class
 	neigh_.resize (neighbors);
 	startHorizon_.resize (neighbors);
@@ -220,48 +275,9 @@ WimshBwManagerFairRR::initialize ()
 		}
 	}
 
-	// resize and clear the neighbors' unavailabilites bitmaps
-	neigh_tx_unavl_.resize (neighbors);
-	neigh_tx_unavl_UGS_.resize (neighbors);
-	neigh_tx_unavl_NRTPS_.resize (neighbors);
-	for ( unsigned int ngh = 0 ; ngh < neighbors ; ngh++ ) {
-		neigh_tx_unavl_[ngh].resize (mac_->nchannels());
-		neigh_tx_unavl_UGS_[ngh].resize (mac_->nchannels());
-		neigh_tx_unavl_NRTPS_[ngh].resize (mac_->nchannels());
-		for ( unsigned int ch = 0 ; ch < mac_->nchannels() ; ch++ ) {
-			neigh_tx_unavl_[ngh][ch].resize (HORIZON);
-			neigh_tx_unavl_UGS_[ngh][ch].resize (HORIZON);
-			neigh_tx_unavl_NRTPS_[ngh][ch].resize (HORIZON);
-			for ( unsigned int f = 0 ; f < HORIZON ; f++ ) {
-				neigh_tx_unavl_[ngh][ch][f].reset();
-				neigh_tx_unavl_UGS_[ngh][ch][f].reset();
-				neigh_tx_unavl_NRTPS_[ngh][ch][f].reset();
-			}
-		}
-	}
-
-	self_rx_unavl_.resize (mac_->nchannels());
-	self_tx_unavl_.resize (mac_->nchannels());
-	self_rx_unavl_UGS_.resize (mac_->nchannels());
-	self_tx_unavl_UGS_.resize (mac_->nchannels());
-	self_rx_unavl_NRTPS_.resize (mac_->nchannels());
-	self_tx_unavl_NRTPS_.resize (mac_->nchannels());
-	for ( unsigned int ch = 0 ; ch < mac_->nchannels() ; ch++ ) {
-		self_rx_unavl_[ch].resize (HORIZON);
-		self_tx_unavl_[ch].resize (HORIZON);
-		self_rx_unavl_UGS_[ch].resize (HORIZON);
-		self_tx_unavl_UGS_[ch].resize (HORIZON);
-		self_rx_unavl_NRTPS_[ch].resize (HORIZON);
-		self_tx_unavl_NRTPS_[ch].resize (HORIZON);
-		for ( unsigned int f = 0 ; f < HORIZON ; f++ ) {
-			self_rx_unavl_[ch][f].reset();
-			self_tx_unavl_[ch][f].reset();
-			self_rx_unavl_UGS_[ch][f].reset();
-			self_tx_unavl_UGS_[ch][f].reset();
-			self_rx_unavl_NRTPS_[ch][f].reset();
-			self_tx_unavl_NRTPS_[ch][f].reset();
-		}
-	}
+	// allocate and clear the slot-state engine
+	// in compact mode, the planes of each neighbor are allocated on demand
+	slots_.initialize (neighbors, mac_->nchannels(), mac_->compact());
 
 	unDschState_.resize (neighbors);
 	rtpsDschFrame_.resize (neighbors);
@@ -275,12 +291,61 @@ WimshBwManagerFairRR::initialize ()
 	unconfirmed_[0].resize (neighbors);
 	unconfirmed_[1].resize (neighbors);
 
+	// scratch buffers, reset in place on each use
+	grantFitStatus_.resize (neighbors);
+	gntNeigh_.reserve (mac_->topology()->numNodes());
+	rtpsNeigh_.reserve (neighbors);
+
+	// one reservation list per <neighbor, service, direction>
+	rsv_.assign (neighbors * wimax::N_SERV_CLASS * N_RSV_DIR,
+			std::list<Reservation>());
+
 	// initialize the weight manager
 	wm_.initialize ();
 }
 
+//! Return the number of bytes allocated by a list, elements included.
+template<typename T>
+static unsigned long
+listMemory (const std::list<T>& l)
+{
+	return l.size() * ( sizeof(T) + 2 * sizeof(void*) );
+}
+
+template<unsigned int S>
+unsigned long
+WimshBwManagerFairRR<S>::memory ()
+{
+	unsigned long bytes = WimshBwManager::memory () + slots_.memory () +
+		neigh_.capacity() * sizeof(std::vector<NeighDesc>) +
+		rsv_.capacity() * sizeof(std::list<Reservation>) +
+		grantFitStatus_.capacity() * sizeof(grantFitDesc) +
+		gntNeigh_.capacity() * sizeof(WimaxNodeId) +
+		rtpsNeigh_.capacity() * sizeof(unsigned int) +
+		grantFitWindow_.capacity() * sizeof(Row) +
+		send_rtps_together_.capacity() / 8 +
+		listMemory (pendingGrants_);
+
+	for ( unsigned int ngh = 0 ; ngh < neigh_.size() ; ngh++ )
+		bytes += neigh_[ngh].capacity() * sizeof(NeighDesc);
+	for ( unsigned int s = 0 ; s < wimax::N_SERV_CLASS ; s++ )
+		bytes += activeList_[s].memory ();
+	for ( unsigned int i = 0 ; i < rsv_.size() ; i++ )
+		bytes += listMemory (rsv_[i]);
+	for ( unsigned int u = 0 ; u < 2 ; u++ ) {
+		bytes += unconfirmed_[u].capacity() *
+			sizeof(std::list<WimshMshDsch::GntIE>);
+		for ( unsigned int ngh = 0 ; ngh < unconfirmed_[u].size() ; ngh++ )
+			bytes += listMemory (unconfirmed_[u][ngh]);
+		bytes += listMemory (grantWaiting_[u]) + listMemory (availabilities_[u]);
+	}
+
+	return bytes;
+}
+
+template<unsigned int S>
 void
-WimshBwManagerFairRR::recvMshDsch (WimshMshDsch* dsch)
+WimshBwManagerFairRR<S>::recvMshDsch (WimshMshDsch* dsch)
 {
 	if ( WimaxDebug::trace("WBWM::recvMshDsch") ) fprintf (stderr,
 			"%.9f WBWM::recvMshDsch[%d]\n", NOW, mac_->nodeId());
@@ -308,11 +373,13 @@ WimshBwManagerFairRR::recvMshDsch (WimshMshDsch* dsch)
 
 	rcvAvailabilities(dsch);	// we interpret AvlIEs first so we can correctly grant bandwidth afterwards
 	rcvGrants(dsch);			// we interpret GntIEs second so that bandwidth cancelations are processed before requests
+	slots_.apply (batch_);	// the updates of the slot state are applied at once
 	rcvRequests(dsch);
 }
 
+template<unsigned int S>
 void
-WimshBwManagerFairRR::rcvGrants (WimshMshDsch* dsch)
+WimshBwManagerFairRR<S>::rcvGrants (WimshMshDsch* dsch)
 {
 	// breakpoint triggers
 	unsigned int tnode = mac_->nodeId();
@@ -362,13 +429,14 @@ WimshBwManagerFairRR::rcvGrants (WimshMshDsch* dsch)
 			// for UGS, we cancel the reservations; for other services, we note the cancel request
 			if ( it->service_ == wimax::UGS ) {
 				// cancel reservation
-				setSlots (busy_UGS_, 						it->frame_, 128, it->start_, it->range_, false);
-				setSlots (self_rx_unavl_UGS_[it->channel_],	it->frame_, 128, it->start_, it->range_, false);
-//				setSlots (neigh_tx_unavl_UGS_[sndx][ch],	it->frame_, 128, it->start_, it->range_, false);
-
-				setSlots (dst_, 	it->frame_, 128, it->start_, it->range_, UINT_MAX);
-				setSlots (grants_, 	it->frame_, 128, it->start_, it->range_, false);
-				setSlots (service_, it->frame_, 128, it->start_, it->range_, 9);
+				batch_.mark (slots_.busy (), Slots::L_UGS, it->frame_, 128, it->start_, it->range_, false);
+				batch_.mark (slots_.selfRx (it->channel_), Slots::L_UGS, it->frame_, 128, it->start_, it->range_, false);
+//				batch_.mark (slots_.neighTx (sndx, ch), Slots::L_UGS, it->frame_, 128, it->start_, it->range_, false);
+
+				table_.set (Alloc::F_DST, 	it->frame_, 128, it->start_, it->range_, UINT_MAX);
+				table_.set (Alloc::F_TX, 	it->frame_, 128, it->start_, it->range_, false);
+				table_.set (Alloc::F_SERVICE, it->frame_, 128, it->start_, it->range_, 9);
+				dropReservations (wimax::UGS, it->start_, it->range_);
 			} else {
 				// store the bandwidth cancel order for the service
 			}
@@ -408,7 +476,7 @@ WimshBwManagerFairRR::rcvGrants (WimshMshDsch* dsch)
 
 			if ( serv == wimax::UGS ) {
 				// if we received a grant for UGS, mark the granted slots in unconfirmedSlots_UGS_
-				setSlots (unconfirmedSlots_UGS_, it->frame_, frange,
+				batch_.mark (slots_.unconfirmed (), Slots::L_UGS, it->frame_, frange,
 						it->start_, it->range_, true);
 			} else { // not UGS
 				if ( serv == wimax::NRTPS ) {
@@ -417,7 +485,7 @@ WimshBwManagerFairRR::rcvGrants (WimshMshDsch* dsch)
 					//unsigned int slots = ( it->range_ > nrtpsMinSlots_ ) ? it->range_ : nrtpsMinSlots_;
 
 					// mark the granted slot range for nrtPS in unconfirmedSlots_NRTPS_
-					setSlots (unconfirmedSlots_NRTPS_, it->frame_, frange,
+					batch_.mark (slots_.unconfirmed (), Slots::L_NRTPS, it->frame_, frange,
 							it->start_, slots, true);
 
 					if ( WimaxDebug::trace("WBWM::rcvGrants") ) fprintf (stderr,
@@ -425,7 +493,7 @@ WimshBwManagerFairRR::rcvGrants (WimshMshDsch* dsch)
 								NOW, mac_->nodeId(), it->frame_, it->start_, slots);
 				}
 				// mark the granted slot range in unconfirmed_ ; NOTE: does not run for UGS, why?
-				setSlots (unconfirmedSlots_, it->frame_, frange,
+				batch_.mark (slots_.unconfirmed (), Slots::L_DEF, it->frame_, frange,
 						it->start_, it->range_, true);
 			}
 
@@ -434,6 +502,7 @@ WimshBwManagerFairRR::rcvGrants (WimshMshDsch* dsch)
 				frange * mac_->slots2bytes (ndx, it->range_, true);
 			Stat::put ( "wimsh_gnt_out", mac_->index(),
 				frange * mac_->slots2bytes (ndx, it->range_, true) );
+			handshakeStage (ndx, serv, HS_GRANT);
 
 			// we enforce the number of granted bytes to be smaller than
 			// that of requested bytes
@@ -497,23 +566,23 @@ WimshBwManagerFairRR::rcvGrants (WimshMshDsch* dsch)
 			// set the minislots as unavailable to transmit to granter
 			for ( unsigned int ch = 0 ; ch < mac_->nchannels() ; ch++ ) {
 				if ( serv == wimax::UGS ) {
-					setSlots (neigh_tx_unavl_UGS_[ndx][ch], it->frame_, frange,
+					batch_.mark (slots_.neighTx (ndx, ch), Slots::L_UGS, it->frame_, frange,
 							it->start_, it->range_, true);
 				} else {
 					if ( serv == wimax::NRTPS ) {
 						unsigned int slots = ( it->range_ > nrtpsMinSlots_ ) ? nrtpsMinSlots_ : it->range_;
 
-						setSlots (neigh_tx_unavl_NRTPS_[ndx][ch], it->frame_, frange,
+						batch_.mark (slots_.neighTx (ndx, ch), Slots::L_NRTPS, it->frame_, frange,
 								it->start_, slots, true);
 //						if ( WimaxDebug::enabled() ) fprintf (stderr,
 //							"!!marquei com nrtpsMin_ a frame %d start %d slots %d\n",
 //								it->frame_, it->start_, slots);
 					}
 
-					setSlots (neigh_tx_unavl_[ndx][ch], it->frame_, frange,
+					batch_.mark (slots_.neighTx (ndx, ch), Slots::L_DEF, it->frame_, frange,
 							it->start_, it->range_, true);
 				}
-				setSlots (service_, it->frame_, frange,	it->start_, it->range_, serv);
+				table_.set (Alloc::F_SERVICE, it->frame_, frange,	it->start_, it->range_, serv);
 			}
 
 			//
@@ -529,23 +598,23 @@ WimshBwManagerFairRR::rcvGrants (WimshMshDsch* dsch)
 				// set the minislots as unavailable to transmit to requester
 				for ( unsigned int ch = 0 ; ch < mac_->nchannels() ; ch++ ) {
 					if ( serv == wimax::UGS ) {
-						setSlots (neigh_tx_unavl_UGS_[ndx][ch], it->frame_, frange,
+						batch_.mark (slots_.neighTx (ndx, ch), Slots::L_UGS, it->frame_, frange,
 								it->start_, it->range_, true);
 					} else {
 						if ( serv == wimax::NRTPS ) {
 							unsigned int slots = ( it->range_ > nrtpsMinSlots_ ) ? nrtpsMinSlots_ : it->range_;
 
-							setSlots (neigh_tx_unavl_NRTPS_[ndx][ch], it->frame_, frange,
+							batch_.mark (slots_.neighTx (ndx, ch), Slots::L_NRTPS, it->frame_, frange,
 									it->start_, slots, true);
 //							if ( WimaxDebug::enabled() ) fprintf (stderr,
 //								"!!marquei com nrtpsMin_ a frame %d start %d slots %d\n",
 //									it->frame_, it->start_, slots);
 						}
 
-						setSlots (neigh_tx_unavl_[ndx][ch], it->frame_, frange,
+						batch_.mark (slots_.neighTx (ndx, ch), Slots::L_DEF, it->frame_, frange,
 								it->start_, it->range_, true);
 					}
-					setSlots (service_, it->frame_, frange,	it->start_, it->range_, serv);
+					table_.set (Alloc::F_SERVICE, it->frame_, frange,	it->start_, it->range_, serv);
 				}
 			}
 
@@ -557,7 +626,8 @@ WimshBwManagerFairRR::rcvGrants (WimshMshDsch* dsch)
 			// ???? what's the difference for this condition to taht one below
 			//
 
-			std::vector<WimaxNodeId> gntNeigh;  // array of the granter's neighbors
+			std::vector<WimaxNodeId>& gntNeigh = gntNeigh_;  // array of the granter's neighbors
+			gntNeigh.clear ();
 			mac_->topology()->neighbors (dsch->src(), gntNeigh); // retrieve them
 			for ( unsigned int ngh = 0 ; ngh < gntNeigh.size() ; ngh++ ) {
 
@@ -571,23 +641,23 @@ WimshBwManagerFairRR::rcvGrants (WimshMshDsch* dsch)
 				const unsigned int ndx = mac_->neigh2ndx (gntNeigh[ngh]); // index
 
 				if ( serv == wimax::UGS ) {
-					setSlots (neigh_tx_unavl_UGS_[ndx][it->channel_],
+					batch_.mark (slots_.neighTx (ndx, it->channel_), Slots::L_UGS,
 							it->frame_, frange, it->start_, it->range_, true);
 				} else {
 					if ( serv == wimax::NRTPS ) {
 						unsigned int slots = ( it->range_ > nrtpsMinSlots_ ) ? nrtpsMinSlots_ : it->range_;
 
-						setSlots (neigh_tx_unavl_NRTPS_[ndx][it->channel_], it->frame_, frange,
+						batch_.mark (slots_.neighTx (ndx, it->channel_), Slots::L_NRTPS, it->frame_, frange,
 								it->start_, slots, true);
 //						if ( WimaxDebug::enabled() ) fprintf (stderr,
 //							"!!marquei com nrtpsMin_ a frame %d start %d slots %d\n",
 //								it->frame_, it->start_, slots);
 					}
 
-					setSlots (neigh_tx_unavl_[ndx][it->channel_],
+					batch_.mark (slots_.neighTx (ndx, it->channel_), Slots::L_DEF,
 							it->frame_, frange, it->start_, it->range_, true);
 				}
-				setSlots (service_, it->frame_, frange, it->start_,
+				table_.set (Alloc::F_SERVICE, it->frame_, frange, it->start_,
 						it->range_, serv);
 			}
 
@@ -596,23 +666,23 @@ WimshBwManagerFairRR::rcvGrants (WimshMshDsch* dsch)
 			// channel (ie. to confirm bandwidth, even though it has been granted)
 			//
 			if ( serv == wimax::UGS ) {
-				setSlots (self_tx_unavl_UGS_[it->channel_],
+				batch_.mark (slots_.selfTx (it->channel_), Slots::L_UGS,
 						it->frame_, frange, it->start_, it->range_, true);
 			} else {
 				if ( serv == wimax::NRTPS ) {
 					unsigned int slots = ( it->range_ > nrtpsMinSlots_ ) ? nrtpsMinSlots_ : it->range_;
 
-					setSlots (self_tx_unavl_NRTPS_[it->channel_], it->frame_, frange,
+					batch_.mark (slots_.selfTx (it->channel_), Slots::L_NRTPS, it->frame_, frange,
 							it->start_, slots, true);
 //					if ( WimaxDebug::enabled() ) fprintf (stderr,
 //						"!!marquei com nrtpsMin_ a frame %d start %d slots %d\n",
 //							it->frame_, it->start_, slots);
 				}
 
-				setSlots (self_tx_unavl_[it->channel_],
+				batch_.mark (slots_.selfTx (it->channel_), Slots::L_DEF,
 						it->frame_, frange, it->start_, it->range_, true);
 			}
-			setSlots (service_, it->frame_, frange, it->start_,
+			table_.set (Alloc::F_SERVICE, it->frame_, frange, it->start_,
 					it->range_, serv);
 		} // if ( it->fromRequester_ == false && it->nodeId_ != mac_->nodeId() )
 
@@ -644,44 +714,44 @@ WimshBwManagerFairRR::rcvGrants (WimshMshDsch* dsch)
 			// set the minislots as unavailable for reception on all channels
 			for ( unsigned int ch = 0 ; ch < mac_->nchannels() ; ch++ ) {
 				if ( serv == wimax::UGS ) {
-					setSlots (neigh_tx_unavl_UGS_[ndx][ch], fstart, frange,
+					batch_.mark (slots_.neighTx (ndx, ch), Slots::L_UGS, fstart, frange,
 							it->start_, it->range_, true);
 				} else {
 					if ( serv == wimax::NRTPS ) {
 						unsigned int slots = ( it->range_ > nrtpsMinSlots_ ) ? nrtpsMinSlots_ : it->range_;
 
-						setSlots (neigh_tx_unavl_NRTPS_[ndx][ch], fstart, frange,
+						batch_.mark (slots_.neighTx (ndx, ch), Slots::L_NRTPS, fstart, frange,
 								it->start_, slots, true);
 //						if ( WimaxDebug::enabled() ) fprintf (stderr,
 //							"!!marquei com nrtpsMin_ a frame %d start %d slots %d\n",
 //								it->frame_, it->start_, slots);
 					}
 
-					setSlots (neigh_tx_unavl_[ndx][ch], fstart, frange,
+					batch_.mark (slots_.neighTx (ndx, ch), Slots::L_DEF, fstart, frange,
 						it->start_, it->range_, true);
 				}
 			}
 
 			// set the minislots as unavailable for reception at this node
 			if ( serv == wimax::UGS ) {
-				setSlots (self_rx_unavl_UGS_[it->channel_], fstart, frange,
+				batch_.mark (slots_.selfRx (it->channel_), Slots::L_UGS, fstart, frange,
 						it->start_, it->range_, true);
 			} else {
 				if ( serv == wimax::NRTPS ) {
 					unsigned int slots = ( it->range_ > nrtpsMinSlots_ ) ? nrtpsMinSlots_ : it->range_;
 
-					setSlots (self_rx_unavl_NRTPS_[it->channel_], fstart, frange,
+					batch_.mark (slots_.selfRx (it->channel_), Slots::L_NRTPS, fstart, frange,
 							it->start_, slots, true);
 //					if ( WimaxDebug::enabled() ) fprintf (stderr,
 //						"!!marquei com nrtpsMin_ a frame %d start %d slots %d\n",
 //							it->frame_, it->start_, slots);
 				}
 
-				setSlots (self_rx_unavl_[it->channel_], fstart, frange,
+				batch_.mark (slots_.selfRx (it->channel_), Slots::L_DEF, fstart, frange,
 					it->start_, it->range_, true);
 			}
 			// again, no need to reset service allocations, we're only marking the slots
-//			setSlots (service_, fstart, frange, it->start_,
+//			table_.set (Alloc::F_SERVICE, fstart, frange, it->start_,
 //					it->range_, serv);
 		}
 
@@ -701,16 +771,31 @@ WimshBwManagerFairRR::rcvGrants (WimshMshDsch* dsch)
 			// get the local identifier of the node who sent this MSH-DSCH
 			unsigned int ndx = mac_->neigh2ndx (dsch->src());
 
+			// the minislots confirmed will not be regranted, while those
+			// already reclaimed may have been granted to someone else
+			if ( regrantEnabled_ && serv != wimax::UGS &&
+					! confirmPendingGrant (ndx, *it) ) {
+				if ( WimaxDebug::trace("WBWM::rcvGrants") ) fprintf (stderr,
+						"\tignoring confirmation: src %d frame %d start %d range %d serv %d\n",
+						dsch->src(), it->frame_, it->start_, it->range_, serv);
+				Stat::put ("wimsh_regnt_late_cnf", mac_->index(), it->range_);
+				continue;
+			}
+
 			// get number of frames over which the confirmation spans
 			// we assume that the persistence_ is not 'forever'
 			// we assume that bandwidth requests are not canceled
 			unsigned int frange = WimshMshDsch::pers2frames(it->persistence_);
 
 			// listen to the specified channel in the confirmed set of slots
-			setSlots (channel_, it->frame_, frange,
+			table_.set (Alloc::F_CHANNEL, it->frame_, frange,
 					it->start_, it->range_, it->channel_);
 
-			setSlots (src_, it->frame_, frange, it->start_, it->range_, dsch->src());
+			table_.set (Alloc::F_SRC, it->frame_, frange, it->start_, it->range_, dsch->src());
+
+			// register the UGS reservation, so that it can be canceled
+			if ( serv == wimax::UGS )
+				addReservation (ndx, serv, RSV_RX, it->frame_, frange, it->start_, it->range_);
 
 			// update the number of bytes confirmed
 			neigh_[ndx][serv].cnf_in_ +=
@@ -732,8 +817,9 @@ WimshBwManagerFairRR::rcvGrants (WimshMshDsch* dsch)
 	} // process the next GrantIE in the DSCH
 }
 
+template<unsigned int S>
 void
-WimshBwManagerFairRR::rcvAvailabilities (WimshMshDsch* dsch)
+WimshBwManagerFairRR<S>::rcvAvailabilities (WimshMshDsch* dsch)
 {
 	// breakpoint triggers
 	unsigned int tnode = mac_->nodeId();
@@ -761,11 +847,11 @@ WimshBwManagerFairRR::rcvAvailabilities (WimshMshDsch* dsch)
 			if ( it->direction_ == WimshMshDsch::RX_AVL &&
 				mac_->topology()->neighbors (dsch->src(), mac_->nodeId()) ) {
 
-				setSlots (self_rx_unavl_UGS_[it->channel_],
+				batch_.mark (slots_.selfRx (it->channel_), Slots::L_UGS,
 						  it->frame_, WimshMshDsch::pers2frames(it->persistence_), it->start_, it->range_, false);
 
 				for ( unsigned int ch = 0 ; ch < mac_->nchannels() ; ch++ ) {
-					setSlots (neigh_tx_unavl_UGS_[ndx][ch],
+					batch_.mark (slots_.neighTx (ndx, ch), Slots::L_UGS,
 							  it->frame_, WimshMshDsch::pers2frames(it->persistence_), it->start_, it->range_, false);
 				}
 
@@ -773,15 +859,16 @@ WimshBwManagerFairRR::rcvAvailabilities (WimshMshDsch* dsch)
 			else if ( it->direction_ == WimshMshDsch::TX_AVL &&
 					   mac_->topology()->neighbors (dsch->src(), mac_->nodeId()) ) {
 
-				setSlots (self_tx_unavl_UGS_[it->channel_],
+				batch_.mark (slots_.selfTx (it->channel_), Slots::L_UGS,
 						  it->frame_, WimshMshDsch::pers2frames(it->persistence_), it->start_, it->range_, false);
 
 				for ( unsigned int ch = 0 ; ch < mac_->nchannels() ; ch++ ) {
-					setSlots (neigh_tx_unavl_UGS_[ndx][ch],
+					batch_.mark (slots_.neighTx (ndx, ch), Slots::L_UGS,
 							  it->frame_, WimshMshDsch::pers2frames(it->persistence_), it->start_, it->range_, false);
 				}
 
-				std::vector<WimaxNodeId> gntNeigh;  // array of the granter's neighbors
+				std::vector<WimaxNodeId>& gntNeigh = gntNeigh_;  // array of the granter's neighbors
+				gntNeigh.clear ();
 				mac_->topology()->neighbors (dsch->src(), gntNeigh); // retrieve them
 				for ( unsigned int ngh = 0 ; ngh < gntNeigh.size() ; ngh++ ) {
 
@@ -793,15 +880,15 @@ WimshBwManagerFairRR::rcvAvailabilities (WimshMshDsch* dsch)
 					// otherwise, set the granted slots as unavailable
 					const unsigned int n = mac_->neigh2ndx (gntNeigh[ngh]); // index
 
-					setSlots (neigh_tx_unavl_UGS_[n][it->channel_],
+					batch_.mark (slots_.neighTx (n, it->channel_), Slots::L_UGS,
 							  it->frame_, WimshMshDsch::pers2frames(it->persistence_), it->start_, it->range_, false);
 				}
 
 				// turn unavailable a range of slots (standard case)
 			} else {
-				setSlots (neigh_tx_unavl_UGS_[ndx][it->channel_],
+				batch_.mark (slots_.neighTx (ndx, it->channel_), Slots::L_UGS,
 						  fstart, frange, it->start_, it->range_, true);
-				setSlots (service_, fstart, frange,
+				table_.set (Alloc::F_SERVICE, fstart, frange,
 						  it->start_, it->range_, it->service_);
 			}
 
@@ -812,23 +899,23 @@ WimshBwManagerFairRR::rcvAvailabilities (WimshMshDsch* dsch)
 			if ( it->direction_ == WimshMshDsch::RX_AVL &&
 					mac_->topology()->neighbors (dsch->src(), mac_->nodeId()) ) {
 
-				setSlots (self_rx_unavl_[it->channel_],
+				batch_.mark (slots_.selfRx (it->channel_), Slots::L_DEF,
 						it->frame_, WimshMshDsch::pers2frames(it->persistence_), it->start_, it->range_, false);
 
-				setSlots (self_rx_unavl_UGS_[it->channel_],
+				batch_.mark (slots_.selfRx (it->channel_), Slots::L_UGS,
 						  it->frame_, WimshMshDsch::pers2frames(it->persistence_), it->start_, it->range_, false);
 
-				setSlots (grants_, it->frame_, WimshMshDsch::pers2frames(it->persistence_),
+				table_.set (Alloc::F_TX, it->frame_, WimshMshDsch::pers2frames(it->persistence_),
 						it->start_, it->range_, false);
 
-				setSlots (dst_, it->frame_, WimshMshDsch::pers2frames(it->persistence_),
+				table_.set (Alloc::F_DST, it->frame_, WimshMshDsch::pers2frames(it->persistence_),
 						it->start_, it->range_, 999);
 
-				setSlots (src_, it->frame_, WimshMshDsch::pers2frames(it->persistence_),
+				table_.set (Alloc::F_SRC, it->frame_, WimshMshDsch::pers2frames(it->persistence_),
 						it->start_, it->range_, 999);
 
 				for ( unsigned int ch = 0 ; ch < mac_->nchannels() ; ch++ ) {
-					setSlots (neigh_tx_unavl_[ndx][ch],
+					batch_.mark (slots_.neighTx (ndx, ch), Slots::L_DEF,
 							it->frame_, WimshMshDsch::pers2frames(it->persistence_), it->start_, it->range_, false);
 				}
 
@@ -836,42 +923,43 @@ WimshBwManagerFairRR::rcvAvailabilities (WimshMshDsch* dsch)
 			} else if ( it->direction_ == WimshMshDsch::TX_AVL &&
 					mac_->topology()->neighbors (dsch->src(), mac_->nodeId()) ) {
 
-				setSlots (self_tx_unavl_[it->channel_],
+				batch_.mark (slots_.selfTx (it->channel_), Slots::L_DEF,
 						it->frame_, WimshMshDsch::pers2frames(it->persistence_), it->start_, it->range_, false);
 
-				setSlots (self_tx_unavl_UGS_[it->channel_],
+				batch_.mark (slots_.selfTx (it->channel_), Slots::L_UGS,
 						  it->frame_, WimshMshDsch::pers2frames(it->persistence_), it->start_, it->range_, false);
 
-				setSlots (busy_, it->frame_, WimshMshDsch::pers2frames(it->persistence_),
+				batch_.mark (slots_.busy (), Slots::L_DEF, it->frame_, WimshMshDsch::pers2frames(it->persistence_),
 									it->start_, it->range_, false);
 
-				setSlots (busy_UGS_, it->frame_, WimshMshDsch::pers2frames(it->persistence_),
+				batch_.mark (slots_.busy (), Slots::L_UGS, it->frame_, WimshMshDsch::pers2frames(it->persistence_),
 						  it->start_, it->range_, false);
 
-				setSlots (unconfirmedSlots_, it->frame_, WimshMshDsch::pers2frames(it->persistence_),
+				batch_.mark (slots_.unconfirmed (), Slots::L_DEF, it->frame_, WimshMshDsch::pers2frames(it->persistence_),
 									it->start_, it->range_, true);
 
-				setSlots (unconfirmedSlots_UGS_, it->frame_, WimshMshDsch::pers2frames(it->persistence_),
+				batch_.mark (slots_.unconfirmed (), Slots::L_UGS, it->frame_, WimshMshDsch::pers2frames(it->persistence_),
 						  it->start_, it->range_, true);
 
-				setSlots (service_, it->frame_, WimshMshDsch::pers2frames(it->persistence_),
+				table_.set (Alloc::F_SERVICE, it->frame_, WimshMshDsch::pers2frames(it->persistence_),
 						it->start_, it->range_, it->service_);
 
-				setSlots (grants_, it->frame_, WimshMshDsch::pers2frames(it->persistence_),
+				table_.set (Alloc::F_TX, it->frame_, WimshMshDsch::pers2frames(it->persistence_),
 						it->start_, it->range_, false);
 
-				setSlots (dst_, it->frame_, WimshMshDsch::pers2frames(it->persistence_),
+				table_.set (Alloc::F_DST, it->frame_, WimshMshDsch::pers2frames(it->persistence_),
 						it->start_, it->range_, 999);
 
-				setSlots (src_, it->frame_, WimshMshDsch::pers2frames(it->persistence_),
+				table_.set (Alloc::F_SRC, it->frame_, WimshMshDsch::pers2frames(it->persistence_),
 						it->start_, it->range_, 999);
 
 				for ( unsigned int ch = 0 ; ch < mac_->nchannels() ; ch++ ) {
-					setSlots (neigh_tx_unavl_[ndx][ch],
+					batch_.mark (slots_.neighTx (ndx, ch), Slots::L_DEF,
 							it->frame_, WimshMshDsch::pers2frames(it->persistence_), it->start_, it->range_, false);
 				}
 
-				std::vector<WimaxNodeId> gntNeigh;  // array of the granter's neighbors
+				std::vector<WimaxNodeId>& gntNeigh = gntNeigh_;  // array of the granter's neighbors
+				gntNeigh.clear ();
 				mac_->topology()->neighbors (dsch->src(), gntNeigh); // retrieve them
 				for ( unsigned int ngh = 0 ; ngh < gntNeigh.size() ; ngh++ ) {
 
@@ -883,27 +971,27 @@ WimshBwManagerFairRR::rcvAvailabilities (WimshMshDsch* dsch)
 					// otherwise, set the granted slots as unavailable
 					const unsigned int n = mac_->neigh2ndx (gntNeigh[ngh]); // index
 
-					setSlots (neigh_tx_unavl_[n][it->channel_],
+					batch_.mark (slots_.neighTx (n, it->channel_), Slots::L_DEF,
 							it->frame_, WimshMshDsch::pers2frames(it->persistence_), it->start_, it->range_, false);
 				}
 
 			// turn unavailable a range of slots (standard case)
 			} else {
-				setSlots (neigh_tx_unavl_[ndx][it->channel_],
+				batch_.mark (slots_.neighTx (ndx, it->channel_), Slots::L_DEF,
 						fstart, frange, it->start_, it->range_, true);
 
-				setSlots (neigh_tx_unavl_UGS_[ndx][it->channel_],
+				batch_.mark (slots_.neighTx (ndx, it->channel_), Slots::L_UGS,
 						  fstart, frange, it->start_, it->range_, true);
 
 				// should an availabilityIE be able to change slot service allocations? me thinks not
-//				setSlots (service_, fstart, frange,
+//				table_.set (Alloc::F_SERVICE, fstart, frange,
 //						it->start_, it->range_, it->service_);
 
 				if ( it->service_ == wimax::NRTPS && nrtPS_slots[ndx] > 0 ) {
 
 					unsigned int slots = ( it->range_ > nrtPS_slots[ndx] ) ? nrtPS_slots[ndx] : it->range_;
 
-					setSlots (neigh_tx_unavl_NRTPS_[ndx][it->channel_], fstart, frange,
+					batch_.mark (slots_.neighTx (ndx, it->channel_), Slots::L_NRTPS, fstart, frange,
 							it->start_, slots, true);
 
 					nrtPS_slots[ndx] = nrtPS_slots[ndx] - slots;
@@ -917,8 +1005,9 @@ WimshBwManagerFairRR::rcvAvailabilities (WimshMshDsch* dsch)
 	}
 }
 
+template<unsigned int S>
 void
-WimshBwManagerFairRR::rcvRequests (WimshMshDsch* dsch)
+WimshBwManagerFairRR<S>::rcvRequests (WimshMshDsch* dsch)
 {
 	// get the list of bandwidth requests
 	std::list<WimshMshDsch::ReqIE>& req = dsch->req();
@@ -953,6 +1042,10 @@ WimshBwManagerFairRR::rcvRequests (WimshMshDsch* dsch)
 //		neigh_[ndx][s].pers_in_ = it->persistence_;
 		neigh_[ndx][s].level_in_ = it->level_;
 
+		// frame by which the requested rtPS data is due, if any
+		if ( s == wimax::RTPS )
+			neigh_[ndx][s].deadline_ = ( rtpsDeadline_ ) ? it->deadline_ : 0;
+
 		// otherwise, update the status of the req_in_, in bytes
 		// we assume that the persistence_ is not 'forever'
 		// we assume that bandwidth requests are not canceled
@@ -984,8 +1077,9 @@ WimshBwManagerFairRR::rcvRequests (WimshMshDsch* dsch)
 	}
 }
 
+template<unsigned int S>
 void
-WimshBwManagerFairRR::schedule (WimshMshDsch* dsch, unsigned int ndx)
+WimshBwManagerFairRR<S>::schedule (WimshMshDsch* dsch, unsigned int ndx)
 {
 	if ( WimaxDebug::trace("WBWM::schedule") ) {
 		fprintf (stderr, "%.9f WBWM::schedule   [%d]\n", NOW, mac_->nodeId());
@@ -1015,20 +1109,32 @@ WimshBwManagerFairRR::schedule (WimshMshDsch* dsch, unsigned int ndx)
 	const unsigned int neighbors = mac_->nneighs();
 
 	// check for uncoordinated DSCH messages that need to be sent in the control subframe (no slots to send in data subframe)
-	for ( ndx = 0 ; ndx < neighbors ; ndx++ ) {
-		if ( send_rtps_together_[ndx] ) {
+	std::vector<unsigned int>& rtps = rtpsNeigh_;
+	rtps.clear ();
+	for ( ndx = 0 ; ndx < neighbors ; ndx++ )
+		if ( send_rtps_together_[ndx] ) rtps.push_back (ndx);
+
+	// when granting by deadline, the links with the least slack are
+	// served first, so that they get the earliest free minislots
+	if ( rtpsDeadline_ ) {
+		for ( unsigned int i = 1 ; i < rtps.size() ; i++ )
+			for ( unsigned int j = i ; j > 0 && moreUrgent (rtps[j], rtps[j-1]) ; j-- )
+				std::swap (rtps[j], rtps[j-1]);
+	}
 
-			// schedule availabilities into the MSH-DSCH message
-		   if ( avlAdvertise_ ) availabilities (dsch, wimax::RTPS);
+	for ( unsigned int i = 0 ; i < rtps.size() ; i++ ) {
+		ndx = rtps[i];
 
-		   // confirm granted minislot ranges into the MSH-DSCH message
-		   confirm (dsch, ndx, wimax::RTPS);
+		// schedule availabilities into the MSH-DSCH message
+	   if ( avlAdvertise_ ) availabilities (dsch, wimax::RTPS);
 
-		   // add bandwidth grants and requests into the MSH-DSCH message
-		   requestGrant (dsch, ndx, wimax::RTPS);
+	   // confirm granted minislot ranges into the MSH-DSCH message
+	   confirm (dsch, ndx, wimax::RTPS);
 
-		   send_rtps_together_[ndx] = false;
-		}
+	   // add bandwidth grants and requests into the MSH-DSCH message
+	   requestGrant (dsch, ndx, wimax::RTPS);
+
+	   send_rtps_together_[ndx] = false;
 	}
 
 	// normal dsch message
@@ -1047,8 +1153,9 @@ WimshBwManagerFairRR::schedule (WimshMshDsch* dsch, unsigned int ndx)
 
 }
 
+template<unsigned int S>
 void
-WimshBwManagerFairRR::availabilities (WimshMshDsch* dsch, unsigned int serv)
+WimshBwManagerFairRR<S>::availabilities (WimshMshDsch* dsch, unsigned int serv)
 {
 	if ( serv == wimax::RTPS ) {
 
@@ -1116,11 +1223,15 @@ WimshBwManagerFairRR::availabilities (WimshMshDsch* dsch, unsigned int serv)
 		// add the grant to the MSH-DSCH message
 		dsch->add (gnt);
 		//dsch->gntCompact();
+
+		// the regrant deadline starts now
+		if ( regrantEnabled_ && ! gnt.fromRequester_ ) sentPendingGrant (gnt);
 	}
 }
 
+template<unsigned int S>
 void
-WimshBwManagerFairRR::requestGrant (WimshMshDsch* dsch,
+WimshBwManagerFairRR<S>::requestGrant (WimshMshDsch* dsch,
 		unsigned int ndx, unsigned int serv)
 {
 	// breakpoint triggers
@@ -1153,35 +1264,13 @@ WimshBwManagerFairRR::requestGrant (WimshMshDsch* dsch,
 	// number of bytes that can still be allocated into the MSH-DSCH message
 	//unsigned int reqIeOccupancy = 0;
 
-	// the i-th element is true if we requested bandwidth to neighbor i
-	std::vector<bool> neighReq (neighbors, false);
-
-	// array of vectores that stores the number of bytes requested to neighbor i of type service j
-	std::vector< std::vector< unsigned int > > neighReqBytes;
-	neighReqBytes.resize (neighbors);
-	for ( unsigned int i = 0 ; i < neighbors ; i++ ) {
-		neighReqBytes[i].resize (4);
-		for ( unsigned int j = 0 ; j < 4 ; j++ ) neighReqBytes[i][j] = 0;
-	}
-
-	// the i-th element stores the maximum number of bytes that can be
-	// requested to neighbor i in a single IE
-	std::vector<unsigned int> neighReqMax (neighbors);
-	for ( unsigned int i = 0 ; i < neighbors ; i++ ) {
-		neighReqMax[i] =
-			  mac_->phyMib()->slotPerFrame()
-			* mac_->phyMib()->symPerSlot ()
-			* WimshMshDsch::pers2frames (WimshMshDsch::FRAME128)
-			* mac_->alpha (i);
-	}
-
-	// create an array of grantFitDescriptor's to be used during the
-	// grant procedure to keep the current channel/frame/slot to analyze
-	std::vector<grantFitDesc> grantFitStatus (neighbors);
-
 	// reset input counters
 	for ( unsigned int n = 0 ; n < neighbors ; n++ ) {
 
+		// reset the grantFitDescriptor used during the grant procedure
+		// to keep the current channel/frame/slot to analyze
+		grantFitStatus_[n] = grantFitDesc ();
+
 		if ( neigh_[n][serv].gnt_in_ > neigh_[n][serv].req_in_ )
 				neigh_[n][serv].gnt_in_ = neigh_[n][serv].req_in_;
 
@@ -1235,12 +1324,10 @@ WimshBwManagerFairRR::requestGrant (WimshMshDsch* dsch,
 			if ( ! dsch->grant() )
 				break;
 
-			if ( ! activeList_[serv].find (wimax::LinkId(ndx, wimax::IN, serv)) )
+			// move the round robin pointer to the link of ndx, if active
+			if ( ! activeList_[serv].seek (wimax::LinkId(ndx, wimax::IN, serv)) )
 				break;
 
-			while ( activeList_[serv].current().ndx_ != ndx )
-				activeList_[serv].move();
-
 		} else {
 			// get current link information
 			ndx = activeList_[serv].current().ndx_;				// index
@@ -1298,7 +1385,7 @@ WimshBwManagerFairRR::requestGrant (WimshMshDsch* dsch,
 					mac_->frame() + h,				// first eligible frame
 					room,							// room for more grant entries
 					frame_room,
-					grantFitStatus[ndx],			// current grant status
+					grantFitStatus_[ndx],			// current grant status
 					serv,							// traffic class
 					dsch);
 
@@ -1349,13 +1436,20 @@ WimshBwManagerFairRR::requestGrant (WimshMshDsch* dsch,
 
 			realGrantStart (ndx, gnt.frame_, gnt.start_, gnt.range_, gnt.channel_, gnt);
 
+			// count the rtPS grants which start after the deadline
+			if ( serv == wimax::RTPS && neigh_[ndx][serv].deadline_ > 0 )
+				Stat::put ("wimsh_rtps_deadline_miss", mac_->index(),
+						( gnt.frame_ > neigh_[ndx][serv].deadline_ ) ? 1 : 0);
+
 			if ( WimaxDebug::trace("WBWM::requestGrant") ) fprintf (stderr,
 					"\tgranting: src %d dst %d frame %d start %d range %d pers %d serv %d\n",
 					mac_->nodeId(), mac_->ndx2neigh(ndx), gnt.frame_, gnt.start_, gnt.range_, gnt.persistence_, gnt.service_);
 
 			// add the grant to the MSH-DSCH message, if no room save it
 			// in grantWaiting_ list and transmit it on next opportunity
-			if ( dsch->remaining() > WimshMshDsch::GntIE::size() && room == true) {
+			const bool sent =
+				( dsch->remaining() > WimshMshDsch::GntIE::size() && room == true );
+			if ( sent ) {
 				dsch->add (gnt);
 			}
 			else
@@ -1363,24 +1457,27 @@ WimshBwManagerFairRR::requestGrant (WimshMshDsch* dsch,
 
 			// set the granted slots as unavailable for reception
 			if ( serv == wimax::UGS )
-				setSlots (busy_UGS_, gnt.frame_, WimshMshDsch::pers2frames(gnt.persistence_),
+				slots_.mark (slots_.busy (), Slots::L_UGS, gnt.frame_, WimshMshDsch::pers2frames(gnt.persistence_),
 						gnt.start_, gnt.range_, true);
 			else {
 				if ( serv == wimax::NRTPS && nrtPS_slots > 0) {
 					unsigned int slots = ( gnt.range_ > nrtPS_slots ) ? nrtPS_slots : gnt.range_;
 
-					setSlots (busy_NRTPS_, gnt.frame_, WimshMshDsch::pers2frames(gnt.persistence_),
+					slots_.mark (slots_.busy (), Slots::L_NRTPS, gnt.frame_, WimshMshDsch::pers2frames(gnt.persistence_),
 							gnt.start_, slots, true);
 
 					nrtPS_slots = nrtPS_slots - gnt.range_;
 				}
 
-				setSlots (busy_, gnt.frame_, WimshMshDsch::pers2frames(gnt.persistence_),
+				slots_.mark (slots_.busy (), Slots::L_DEF, gnt.frame_, WimshMshDsch::pers2frames(gnt.persistence_),
 						gnt.start_, gnt.range_, true);
 			}
 
-			setSlots (service_, gnt.frame_, WimshMshDsch::pers2frames(gnt.persistence_),
+			table_.set (Alloc::F_SERVICE, gnt.frame_, WimshMshDsch::pers2frames(gnt.persistence_),
 					gnt.start_, gnt.range_, serv);
+
+			// wait for the confirmation, otherwise regrant
+			if ( regrantEnabled_ && serv != wimax::UGS ) addPendingGrant (ndx, gnt, sent);
 		}
 
 		//if ( granted < total_req )
@@ -1473,14 +1570,12 @@ WimshBwManagerFairRR::requestGrant (WimshMshDsch* dsch,
 					// now estimate how many minislots this neighbor is already using to send the data to us
 					unsigned int bwdSlots = mac_->bytes2slots (sndx, fwdBytes, true);
 					// just for checks, get the number of minislots really given by this node to sndx/serv
-					unsigned slotCount = 0;
-					for(unsigned i = 0; i < N; i++)
-					if(src_[F][i] == mac_->ndx2neigh(sndx) && service_[F][i]==serv)
-						slotCount++;
-
-					// uncomment to print src_ to stderr
-//					for(unsigned i=0; i < N; i++) std::cerr << src_[F][i] << " ";
-//					fprintf(stderr, "\n");
+					Alloc::Run key;
+					key.src_ = mac_->ndx2neigh(sndx);
+					key.service_ = serv;
+					const Row from =
+						match (F, key, Alloc::F_SRC | Alloc::F_SERVICE);
+					unsigned slotCount = from.count (0, N);
 
 					// naturally, our estimate can't be larger than the real number of slots allocated
 					if (bwdSlots > slotCount) {
@@ -1499,25 +1594,19 @@ WimshBwManagerFairRR::requestGrant (WimshMshDsch* dsch,
 					// map with available slots (true -> unavailable, false -> available)
 					// !unconfirmed + !busy + !self_tx_unavl
 					// note: we should consider the destination node's unavailabilities to receive
-					std::bitset<MAX_SLOTS> map =
-						unconfirmedSlots_[F] | unconfirmedSlots_UGS_[F] | unconfirmedSlots_NRTPS_[F] |
-						busy_[F] | busy_UGS_[F] | busy_NRTPS_[F] |
-//						neigh_rx_unavl_[ndx][ch][F] | neigh_rx_unavl_UGS_[ndx][ch][F] | neigh_rx_unavl_NRTPS_[ndx][ch][F] |
-						self_tx_unavl_[ch][F] | self_tx_unavl_UGS_[ch][F] | self_tx_unavl_NRTPS_[ch][F];
+					Row map =
+						slots_.any (slots_.unconfirmed (), F) |
+						slots_.any (slots_.busy (), F) |
+						slots_.any (slots_.selfTx (ch), F);
 
 					// uncomment to print map to stderr
 //					for(unsigned i = 0; i<N;i++) std::cerr << map[i];
 //					fprintf(stderr, "\n");
 
-					// minislot start and range
-					unsigned int mstart, mrange;
-					for ( mstart=0; map[mstart] != false && mstart < N; mstart++ ); // get the start point
-					if( mstart != N ) { 	// if at least one slot was found
-						// get the available range
-						for ( mrange = 1; (map[mstart+mrange] == false) && (mstart+mrange < N); mrange++ );
-					} else {
-						mstart = 0; mrange = 0;
-					}
+					// minislot start and range of the first block of available slots
+					unsigned int mstart = map.firstZero (0, N);
+					unsigned int mrange = map.zeroRun (mstart, N);
+					if ( mstart == N ) mstart = 0;
 
 					if ( WimaxDebug::trace("WBWM::requestGrant") && rtPShurry) fprintf (stderr,
 							"\tfwdtraffic: ndx %d needing %d slots to ndx %d, using %d/%d slots, %d available for fwd [%d:%d]\n",
@@ -1530,9 +1619,8 @@ WimshBwManagerFairRR::requestGrant (WimshMshDsch* dsch,
 						cancel = bwdSlots - balance;
 
 						// get the reservation's end point
-						unsigned rsvEnd = 0;
-						for( ; rsvEnd < N && src_[F][rsvEnd] != mac_->ndx2neigh(sndx) ; rsvEnd++);
-						for( ; rsvEnd < N && src_[F][rsvEnd] == mac_->ndx2neigh(sndx) ; rsvEnd++);
+						const Row rsv = match (F, key, Alloc::F_SRC);
+						unsigned rsvEnd = rsv.firstZero (rsv.firstOne (0, N), N);
 
 						// to cancel a request, we create a GrantIE with persistence level CANCEL
 						// cancelations are directed, thus the need for a GrantIE and nodeId_
@@ -1563,13 +1651,14 @@ WimshBwManagerFairRR::requestGrant (WimshMshDsch* dsch,
 
 						// now we cancel the reservations locally, starting in cancelIE.frame_
 						if ( serv == wimax::UGS ) {
-							setSlots (busy_UGS_, 					cancelIE.frame_, 128, cancelIE.start_, cancelIE.range_, false);
-							setSlots (self_rx_unavl_UGS_[ch], 		cancelIE.frame_, 128, cancelIE.start_, cancelIE.range_, false);
-							setSlots (neigh_tx_unavl_UGS_[sndx][ch],cancelIE.frame_, 128, cancelIE.start_, cancelIE.range_, false);
+							slots_.mark (slots_.busy (), Slots::L_UGS, cancelIE.frame_, 128, cancelIE.start_, cancelIE.range_, false);
+							slots_.mark (slots_.selfRx (ch), Slots::L_UGS, cancelIE.frame_, 128, cancelIE.start_, cancelIE.range_, false);
+							slots_.mark (slots_.neighTx (sndx, ch), Slots::L_UGS,cancelIE.frame_, 128, cancelIE.start_, cancelIE.range_, false);
 
-							setSlots (src_, 	cancelIE.frame_, 128, cancelIE.start_, cancelIE.range_, UINT_MAX);
-							setSlots (grants_, 	cancelIE.frame_, 128, cancelIE.start_, cancelIE.range_, false);
-							setSlots (service_, cancelIE.frame_, 128, cancelIE.start_, cancelIE.range_, 9);
+							table_.set (Alloc::F_SRC, 	cancelIE.frame_, 128, cancelIE.start_, cancelIE.range_, UINT_MAX);
+							table_.set (Alloc::F_TX, 	cancelIE.frame_, 128, cancelIE.start_, cancelIE.range_, false);
+							table_.set (Alloc::F_SERVICE, cancelIE.frame_, 128, cancelIE.start_, cancelIE.range_, 9);
+							dropReservations (wimax::UGS, cancelIE.start_, cancelIE.range_);
 
 							// also, create an AvailabilityIE advertising the freed slots
 
@@ -1591,7 +1680,20 @@ WimshBwManagerFairRR::requestGrant (WimshMshDsch* dsch,
 				}	// fwdtraffic handling ends here
 
 				// fill IE with dst nodeid, demand level, demand persistence, service class
-				ie.level_ = req_slots + 3;
+				// the safety margin is trimmed by the minislots per frame which
+				// have not been used since the last request
+				unsigned int margin = 3;
+				NeighDesc& desc = neigh_[ndx][serv];
+				const unsigned int frames = mac_->frame() - desc.unusedFrame_;
+				if ( desc.unused_ > 0 && frames > 0 ) {
+					const unsigned int trim =
+						desc.unused_ / frames / mac_->slots2bytes (ndx, 1, false);
+					margin = ( trim < margin ) ? margin - trim : 0;
+				}
+				desc.unused_ = 0;
+				desc.unusedFrame_ = mac_->frame();
+
+				ie.level_ = req_slots + margin;
 				if (ie.level_ > mac_->phyMib()->slotPerFrame()) // if we ask for too many slots per frame
 					ie.level_ = mac_->phyMib()->slotPerFrame(); // crop
 
@@ -1606,8 +1708,20 @@ WimshBwManagerFairRR::requestGrant (WimshMshDsch* dsch,
 				}
 				ie.service_ = serv;
 
+				// tell the granter by when the queued rtPS data is due
+				ie.deadline_ = 0;
+				if ( rtpsDeadline_ && serv == wimax::RTPS ) {
+					const double due = mac_->scheduler()->deadline (ndx, serv);
+					if ( due > 0 ) {
+						const double slack = ( due > NOW ) ? due - NOW : 0;
+						ie.deadline_ = mac_->frame() + (unsigned int)
+							( slack / mac_->phyMib()->frameDuration() );
+					}
+				}
+
 				// insert the IE into the MSH-DSCH message
 				dsch->add (ie);
+				handshakeStage (ndx, serv, HS_REQUEST);
 
 				// TODO: document this (startHorizon)
 				startHorizon_[ndx][serv] = false;
@@ -1635,8 +1749,9 @@ WimshBwManagerFairRR::requestGrant (WimshMshDsch* dsch,
 	}
 }
 
+template<unsigned int S>
 void
-WimshBwManagerFairRR::confirm (WimshMshDsch* dsch, unsigned int nodeid, unsigned int serv)
+WimshBwManagerFairRR<S>::confirm (WimshMshDsch* dsch, unsigned int nodeid, unsigned int serv)
 {
 	// breakpoint triggers
 	unsigned int tnode = mac_->nodeId();
@@ -1729,26 +1844,31 @@ WimshBwManagerFairRR::confirm (WimshMshDsch* dsch, unsigned int nodeid, unsigned
 
 			// mark the minislots
 			if ( s == wimax::UGS )
-				setSlots (busy_UGS_, fs, fr, gnt.start_, gnt.range_, true);
+				slots_.mark (slots_.busy (), Slots::L_UGS, fs, fr, gnt.start_, gnt.range_, true);
 			else {
 				if ( s == wimax::NRTPS ) {
 					unsigned int slots = ( gnt.range_ > nrtpsMinSlots_ ) ?
 							nrtpsMinSlots_ : gnt.range_;
-					setSlots (busy_NRTPS_, fs, fr, gnt.start_, slots, true);
+					slots_.mark (slots_.busy (), Slots::L_NRTPS, fs, fr, gnt.start_, slots, true);
 				}
-				setSlots (busy_, fs, fr, gnt.start_, gnt.range_, true);
+				slots_.mark (slots_.busy (), Slots::L_DEF, fs, fr, gnt.start_, gnt.range_, true);
 			}
-			setSlots (grants_, fs, fr, gnt.start_, gnt.range_, true);
-			setSlots (dst_, fs, fr, gnt.start_, gnt.range_, gnt.nodeId_);
-			setSlots (src_, fs, fr, gnt.start_, gnt.range_, 999);
-			setSlots (service_, fs, fr, gnt.start_, gnt.range_, s);
-			setSlots (channel_, fs, fr, gnt.start_, gnt.range_, gnt.channel_);
+			table_.set (Alloc::F_TX, fs, fr, gnt.start_, gnt.range_, true);
+			table_.set (Alloc::F_DST, fs, fr, gnt.start_, gnt.range_, gnt.nodeId_);
+			table_.set (Alloc::F_SRC, fs, fr, gnt.start_, gnt.range_, 999);
+			table_.set (Alloc::F_SERVICE, fs, fr, gnt.start_, gnt.range_, s);
+			table_.set (Alloc::F_CHANNEL, fs, fr, gnt.start_, gnt.range_, gnt.channel_);
+
+			// register the UGS reservation, so that it can be canceled
+			if ( s == wimax::UGS )
+				addReservation (ndx, s, RSV_TX, fs, fr, gnt.start_, gnt.range_);
 		}
 
 
 		// update the number of bytes confirmed
 		neigh_[ndx][serv].cnf_out_ += confirmed;
 		Stat::put ("wimsh_cnf_out", mac_->index(), confirmed);
+		if ( confirmed > 0 ) handshakeStage (ndx, serv, HS_CONFIRM);
 
 		// we enforce the number of granted bytes to be smaller than
 		// that of granted bytes
@@ -1765,41 +1885,203 @@ WimshBwManagerFairRR::confirm (WimshMshDsch* dsch, unsigned int nodeid, unsigned
 	}
 }
 
+template<unsigned int S>
 void
-WimshBwManagerFairRR::invalidate (unsigned int F)
+WimshBwManagerFairRR<S>::invalidate (unsigned int F)
 {
 	// compute the number of slots in the current frame
 	// that could have been used to transmit date for measurement purposes
 	const unsigned int unused =
-		mac_->phyMib()->slotPerFrame() - (busy_[F].count() + busy_UGS_[F].count());
+		mac_->phyMib()->slotPerFrame() -
+		(  slots_.row (slots_.busy (), Slots::L_DEF, F).count()
+		 + slots_.row (slots_.busy (), Slots::L_UGS, F).count() );
 	Stat::put ("wimsh_unused_a", mac_->index(), unused);
 	Stat::put ("wimsh_unused_d", mac_->index(), unused);
 
+	// collect the fragmentation of the free minislots
+	fragmentation (F);
+
 	if ( WimaxDebug::trace("WBWM::invalidate") ) fprintf (stderr,
 			"%.9f WBWM::invalidate [%d] unused %d\n", NOW, mac_->nodeId(), unused);
 
-	// reset to default values all data structures of the last frame
-	for ( unsigned int ngh = 0 ; ngh < mac_->nneighs() ; ngh++)
-		for ( unsigned int ch = 0 ; ch < mac_->nchannels() ; ch++ ) {
-			neigh_tx_unavl_[ngh][ch][F].reset();
-			neigh_tx_unavl_NRTPS_[ngh][ch][F].reset();
+	// reclaim the grants which have not been confirmed in time
+	if ( regrantEnabled_ ) regrant ();
+
+	// all data structures of the last frame will be reset to default
+	// values on their next write (UGS reservations are kept, since
+	// they span the whole horizon)
+	slots_.advance (mac_->frame() + 1);
+	WimshBwManager::invalidate (F);
+}
+
+template<unsigned int S>
+void
+WimshBwManagerFairRR<S>::addPendingGrant (unsigned int ndx,
+		const WimshMshDsch::GntIE& gnt, bool sent)
+{
+	PendingGrant pnd;
+	pnd.ndx_ = ndx;
+	pnd.gnt_ = gnt;
+	pnd.sent_ = false;
+	pnd.deadline_ = gnt.frame_;
+	pendingGrants_.push_back (pnd);
+
+	if ( sent ) sentPendingGrant (gnt);
+}
+
+template<unsigned int S>
+void
+WimshBwManagerFairRR<S>::sentPendingGrant (const WimshMshDsch::GntIE& gnt)
+{
+	typename std::list<PendingGrant>::iterator it;
+	for ( it = pendingGrants_.begin() ; it != pendingGrants_.end() ; ++it ) {
+		const WimshMshDsch::GntIE& x = it->gnt_;
+		if ( it->sent_ || x.nodeId_ != gnt.nodeId_ || x.frame_ != gnt.frame_ ||
+				x.start_ != gnt.start_ || x.range_ != gnt.range_ ||
+				x.service_ != gnt.service_ ) continue;
+
+		// the requester may miss its first opportunity to confirm,
+		// eg. if its MSH-DSCH is full, hence one more handshake
+		it->sent_ = true;
+		it->deadline_ = mac_->frame() + regrantOffset_ +
+			( regrantDuration_ + 1 ) * handshake (gnt.nodeId_);
+		return;
+	}
+}
+
+template<unsigned int S>
+bool
+WimshBwManagerFairRR<S>::confirmPendingGrant (unsigned int ndx,
+		const WimshMshDsch::GntIE& cnf)
+{
+	const Row range = Row::range (cnf.start_, cnf.range_);
+
+	// the confirmed minislots must all be granted and not confirmed yet
+	Row outstanding;
+	typename std::list<PendingGrant>::iterator it;
+	for ( it = pendingGrants_.begin() ; it != pendingGrants_.end() ; ++it ) {
+		const WimshMshDsch::GntIE& gnt = it->gnt_;
+		if ( ! it->sent_ || it->ndx_ != ndx || ! covers (gnt, cnf.frame_) ||
+				gnt.service_ != cnf.service_ ) continue;
+		Row granted = Row::range (gnt.start_, gnt.range_);
+		outstanding |= granted.andNot (it->confirmed_);
+	}
+	if ( ! ( ( range & outstanding ) == range ) ) return false;
+
+	it = pendingGrants_.begin();
+	while ( it != pendingGrants_.end() ) {
+		const WimshMshDsch::GntIE& gnt = it->gnt_;
+		if ( ! it->sent_ || it->ndx_ != ndx || ! covers (gnt, cnf.frame_) ||
+				gnt.service_ != cnf.service_ ) { ++it; continue; }
+
+		// remove the grant as soon as it is entirely confirmed
+		const Row granted = Row::range (gnt.start_, gnt.range_);
+		it->confirmed_ |= range & granted;
+		if ( it->confirmed_ == granted ) it = pendingGrants_.erase (it);
+		else                             ++it;
+	}
+	return true;
+}
+
+template<unsigned int S>
+void
+WimshBwManagerFairRR<S>::regrant ()
+{
+	const unsigned int now = mac_->frame();
+
+	// minislots and bytes reclaimed during this frame
+	unsigned int slots = 0;
+	unsigned int bytes = 0;
+
+	typename std::list<PendingGrant>::iterator it = pendingGrants_.begin();
+	while ( it != pendingGrants_.end() ) {
+		if ( it->deadline_ > now ) { ++it; continue; }
+
+		const WimshMshDsch::GntIE& gnt = it->gnt_;
+		const unsigned int ndx = it->ndx_;
+		const unsigned int s = gnt.service_;
+
+		// a grant still waiting to be sent must never be sent
+		if ( ! it->sent_ ) {
+			std::list<WimshMshDsch::GntIE>::iterator jt = grantWaiting_[0].begin();
+			for ( ; jt != grantWaiting_[0].end() ; ++jt ) {
+				if ( ! jt->fromRequester_ && jt->nodeId_ == gnt.nodeId_ &&
+						jt->frame_ == gnt.frame_ && jt->start_ == gnt.start_ &&
+						jt->range_ == gnt.range_ && jt->service_ == gnt.service_ ) {
+					grantWaiting_[0].erase (jt);
+					break;
+				}
+			}
+		}
+
+		// the frames of the grant which are still to come
+		const unsigned int fend = gnt.frame_ + WimshMshDsch::pers2frames (gnt.persistence_);
+		const unsigned int fstart = ( gnt.frame_ > now ) ? gnt.frame_ : now + 1;
+
+		// minislots of the grant which have not been confirmed
+		Row unconfirmed = Row::range (gnt.start_, gnt.range_);
+		unconfirmed.andNot (it->confirmed_);
+
+		// only release the minislots which still belong to this grant,
+		// ie. they have not been borrowed, nor confirmed
+		Alloc::Run key;
+		key.service_ = s;
+		const unsigned int fields = Alloc::F_SERVICE | Alloc::F_SRC | Alloc::F_TX;
+
+		unsigned int recovered = 0;   // minislots
+		unsigned int rbytes = 0;      // bytes
+		for ( unsigned int f = fstart ; f < fend ; f++ ) {
+			const Row map = unconfirmed & match (f, key, fields);
+			unsigned int fslots = 0;
+			for ( unsigned int m = map.firstOne (0, S) ; m < S ; m = map.firstOne (m, S) ) {
+				const unsigned int e = map.firstZero (m, S);
+				slots_.mark (slots_.busy (), Slots::L_DEF, f, 1, m, e - m, false);
+				if ( s == wimax::NRTPS )
+					slots_.mark (slots_.busy (), Slots::L_NRTPS, f, 1, m, e - m, false);
+				table_.set (Alloc::F_SERVICE, f, 1, m, e - m, Alloc::NO_SERVICE);
+				fslots += e - m;
+				m = e;
+			}
+			if ( fslots > 0 ) rbytes += mac_->slots2bytes (ndx, fslots, true);
+			recovered += fslots;
 		}
 
-	for ( unsigned int ch = 0 ; ch < mac_->nchannels() ; ch++ ) {
-		self_rx_unavl_[ch][F].reset();
-		self_tx_unavl_[ch][F].reset();
-		self_rx_unavl_NRTPS_[ch][F].reset();
-		self_tx_unavl_NRTPS_[ch][F].reset();
+		if ( WimaxDebug::trace("WBWM::regrant") ) fprintf (stderr,
+				"%.9f WBWM::regrant    [%d] ndx %d frame %d start %d range %d "
+				"serv %d slots %d bytes %d\n",
+				NOW, mac_->nodeId(), ndx, gnt.frame_, gnt.start_, gnt.range_,
+				s, recovered, rbytes);
+
+		// regrant the bytes reclaimed, unless a new grant would fall
+		// beyond the horizon of the original one
+		const bool regnt = ( ! sameRegrantHorizon_ ||
+				now + handshake (mac_->ndx2neigh (ndx)) < fend );
+		if ( rbytes > 0 && regnt ) {
+			unsigned int& granted = neigh_[ndx][s].gnt_in_;
+			granted = ( granted > rbytes ) ? granted - rbytes : 0;
+
+			const wimax::LinkId link (ndx, wimax::IN, s);
+			if ( neigh_[ndx][s].req_in_ > granted && ! activeList_[s].find (link) )
+				activeList_[s].insert (link);
+
+			// without fairness, the link is served first
+			if ( ! fairRegrant_ ) activeList_[s].seek (link);
+		}
+
+		slots += recovered;
+		bytes += rbytes;
+		it = pendingGrants_.erase (it);
+	}
+
+	if ( slots > 0 ) {
+		Stat::put ("wimsh_regnt_slots", mac_->index(), slots);
+		Stat::put ("wimsh_regnt_bytes", mac_->index(), bytes);
 	}
-	busy_[F].reset();
-	busy_NRTPS_[F].reset();
-	unconfirmedSlots_[F].reset();
-	unconfirmedSlots_NRTPS_[F].reset();
-	WimshBwManager::invalidate (F);
 }
 
+template<unsigned int S>
 void
-WimshBwManagerFairRR::cancel_Requester (unsigned int ndx,
+WimshBwManagerFairRR<S>::cancel_Requester (unsigned int ndx,
 		unsigned char s, WimshMshDsch* dsch)
 {
 	if ( WimaxDebug::enabled() ) fprintf (stderr,"requester vou cancelar o servico UGS\n");
@@ -1813,53 +2095,57 @@ WimshBwManagerFairRR::cancel_Requester (unsigned int ndx,
 	req.level_ = 0;
 	req.persistence_ = WimshMshDsch::CANCEL;
 	req.service_ = s;
+	req.deadline_ = 0;
 	dsch->add (req);
 
+	// locate the reservations towards dst
+	std::vector<Row> masks;
+	if ( ! locateReservations (ndx, s, RSV_TX, fs, masks) ) return;
+
 	// create AvlIE to inform sender's neighbours
 	for ( unsigned int f = fs ; f < ( fs + HORIZON )  ; f++ ) {
 		F = f % HORIZON;
-		for ( unsigned int i = 0 ; i < MAX_SLOTS ; i++ ) {
+		const Row& ugs = masks[f - fs];
 
-			if ( service_[F][i] == s && dst_[F][i] == dst ) {
+		// for each range of UGS minislots towards dst
+		for ( unsigned int i = ugs.firstOne (0, S) ; i < S ;
+				i = ugs.firstOne (i, S) ) {
 
-				WimshMshDsch::AvlIE avl;
-				avl.frame_ = f;
-				avl.start_ = i;
-				avl.direction_ = WimshMshDsch::RX_AVL;	// distinguish from the granter AvlIE
-				avl.persistence_ = WimshMshDsch::FRAME1;
-				avl.channel_ = channel_[F][i];
-				avl.service_ = s;
+			WimshMshDsch::AvlIE avl;
+			avl.frame_ = f;
+			avl.start_ = i;
+			avl.direction_ = WimshMshDsch::RX_AVL;	// distinguish from the granter AvlIE
+			avl.persistence_ = WimshMshDsch::FRAME1;
+			avl.channel_ = table_.at (F, i).channel_;
+			avl.service_ = s;
 
-				for ( ; i < MAX_SLOTS && service_[F][i] == s &&
-						dst_[F][i] == dst ; i++ ) { }
+			i = ugs.firstZero (i, S);
 
-				avl.range_ = i - avl.start_;
+			avl.range_ = i - avl.start_;
 
-				if ( dsch->remaining() > WimshMshDsch::AvlIE::size() )
-					dsch->add (avl);
-				else
-					availabilities_[0].push_back (avl);
-
-				// clear data structures busy with UGS service
-				setSlots (busy_UGS_, avl.frame_, 1,
-						avl.start_, avl.range_, false);
-				setSlots (grants_, avl.frame_, 1,
-						avl.start_, avl.range_, false);
-				setSlots (service_, avl.frame_, 1,
-						avl.start_, avl.range_, 9);
-				setSlots (dst_, avl.frame_, 1,
-						avl.start_, avl.range_, 999);
-				setSlots (channel_, avl.frame_, 1,
-						avl.start_, avl.range_, false);
-				setSlots (unconfirmedSlots_UGS_, avl.frame_, 1,
-						avl.start_, avl.range_, false);
-			}
+			if ( dsch->remaining() > WimshMshDsch::AvlIE::size() )
+				dsch->add (avl);
+			else
+				availabilities_[0].push_back (avl);
+
+			// clear data structures busy with UGS service
+			table_.set (Alloc::F_TX, avl.frame_, 1,
+					avl.start_, avl.range_, false);
+			table_.set (Alloc::F_SERVICE, avl.frame_, 1,
+					avl.start_, avl.range_, 9);
+			table_.set (Alloc::F_DST, avl.frame_, 1,
+					avl.start_, avl.range_, 999);
+			table_.set (Alloc::F_CHANNEL, avl.frame_, 1,
+					avl.start_, avl.range_, false);
 		}
 	}
+	clearReservations (slots_.busy (), fs, masks);
+	clearReservations (slots_.unconfirmed (), fs, masks);
 }
 
+template<unsigned int S>
 void
-WimshBwManagerFairRR::cancel_Granter (unsigned int ndx,
+WimshBwManagerFairRR<S>::cancel_Granter (unsigned int ndx,
 		unsigned char s)
 {
 	if ( WimaxDebug::enabled() ) fprintf (stderr,"granter vou cancelar o servico UGS\n");
@@ -1867,44 +2153,152 @@ WimshBwManagerFairRR::cancel_Granter (unsigned int ndx,
 	unsigned int fs = mac_->frame() + 10;	// !!
 	unsigned int F;
 
+	// locate the reservations from src
+	std::vector<Row> masks;
+	if ( ! locateReservations (ndx, s, RSV_RX, fs, masks) ) return;
+
 	// create AvlIE to inform granter's neighbours
 	for ( unsigned int f = fs ; f < ( fs + HORIZON )  ; f++ ) {
 		F = f % HORIZON;
-		for ( unsigned int i = 0 ; i < MAX_SLOTS ; i++ ) {
+		const Row& ugs = masks[f - fs];
 
-			if ( service_[F][i] == s && src_[F][i] == src ) {
+		// for each range of UGS minislots from src
+		for ( unsigned int i = ugs.firstOne (0, S) ; i < S ;
+				i = ugs.firstOne (i, S) ) {
 
-				WimshMshDsch::AvlIE avl;
-				avl.frame_ = f;
-				avl.start_ = i;
-				avl.direction_ = WimshMshDsch::TX_AVL;
-				avl.persistence_ = WimshMshDsch::FRAME1;
-				avl.channel_ = channel_[F][i];
-				avl.service_ = s;
-
-				for ( ; i < MAX_SLOTS && service_[F][i] == s &&
-						src_[F][i] == src ; i++ ) { }
+			WimshMshDsch::AvlIE avl;
+			avl.frame_ = f;
+			avl.start_ = i;
+			avl.direction_ = WimshMshDsch::TX_AVL;
+			avl.persistence_ = WimshMshDsch::FRAME1;
+			avl.channel_ = table_.at (F, i).channel_;
+			avl.service_ = s;
+
+			i = ugs.firstZero (i, S);
+
+			avl.range_ = i - avl.start_;
+
+			availabilities_[0].push_back (avl);
+
+			// clear data structures busy with UGS service
+			table_.set (Alloc::F_SRC, avl.frame_, 1,
+					avl.start_, avl.range_, 999);
+			table_.set (Alloc::F_SERVICE, avl.frame_, 1,
+					avl.start_, avl.range_, 9);
+			table_.set (Alloc::F_CHANNEL, avl.frame_, 1,
+					avl.start_, avl.range_, false);
+		}
+	}
+	clearReservations (slots_.busy (), fs, masks);
+}
 
-				avl.range_ = i - avl.start_;
+template<unsigned int S>
+void
+WimshBwManagerFairRR<S>::addReservation (unsigned int ndx, unsigned int s,
+		RsvDirection dir, unsigned int frame, unsigned int frange,
+		unsigned int start, unsigned int range)
+{
+	std::list<Reservation>& rsv = reservations (ndx, s, dir);
+
+	// remove the expired reservations
+	typename std::list<Reservation>::iterator it = rsv.begin();
+	while ( it != rsv.end() ) {
+		if ( it->frange_ < HORIZON && it->frame_ + it->frange_ <= mac_->frame() )
+			it = rsv.erase (it);
+		else
+			++it;
+	}
 
-				availabilities_[0].push_back (avl);
+	if ( frange > 0 && range > 0 )
+		rsv.push_back (Reservation (frame, frange, start, range));
+}
 
-				// clear data structures busy with UGS service
-				setSlots (busy_UGS_, avl.frame_, 1,
-						avl.start_, avl.range_, false);
-				setSlots (src_, avl.frame_, 1,
-						avl.start_, avl.range_, 999);
-				setSlots (service_, avl.frame_, 1,
-						avl.start_, avl.range_, 9);
-				setSlots (channel_, avl.frame_, 1,
-						avl.start_, avl.range_, false);
+template<unsigned int S>
+void
+WimshBwManagerFairRR<S>::dropReservations (unsigned int s,
+		unsigned int start, unsigned int range)
+{
+	for ( unsigned int ndx = 0 ; ndx < mac_->nneighs() ; ndx++ ) {
+		for ( unsigned int dir = 0 ; dir < N_RSV_DIR ; dir++ ) {
+			std::list<Reservation>& rsv = reservations (ndx, s, (RsvDirection) dir);
+			typename std::list<Reservation>::iterator it = rsv.begin();
+			while ( it != rsv.end() ) {
+				if ( it->start_ >= start && it->start_ + it->range_ <= start + range )
+					it = rsv.erase (it);
+				else
+					++it;
 			}
 		}
 	}
 }
 
+template<unsigned int S>
+bool
+WimshBwManagerFairRR<S>::locateReservations (unsigned int ndx, unsigned char s,
+		RsvDirection dir, unsigned int fs, std::vector<Row>& masks)
+{
+	std::list<Reservation>& rsv = reservations (ndx, s, dir);
+	if ( rsv.empty() ) return false;
+
+	// collect the minislots of the reservations in each frame
+	masks.assign (HORIZON, Row());
+	typename std::list<Reservation>::iterator it;
+	for ( it = rsv.begin() ; it != rsv.end() ; ++it ) {
+		const Row range = Row::range (it->start_, it->range_);
+		unsigned int first = 0;
+		unsigned int last = HORIZON;
+		if ( it->frange_ < HORIZON ) {
+			first = ( it->frame_ > fs ) ? it->frame_ - fs : 0;
+			last = ( it->frame_ + it->frange_ > fs ) ? it->frame_ + it->frange_ - fs : 0;
+			if ( last > HORIZON ) last = HORIZON;
+		}
+		for ( unsigned int i = first ; i < last ; i++ ) masks[i] |= range;
+	}
+	rsv.clear();
+
+	// only keep the minislots which still belong to the reservations
+	Alloc::Run key;
+	key.service_ = s;
+	unsigned int fields = Alloc::F_SERVICE;
+	if ( dir == RSV_TX ) { key.dst_ = mac_->ndx2neigh (ndx); fields |= Alloc::F_DST; }
+	else                 { key.src_ = mac_->ndx2neigh (ndx); fields |= Alloc::F_SRC; }
+	for ( unsigned int i = 0 ; i < HORIZON ; i++ )
+		if ( masks[i].any() ) masks[i] &= match (fs + i, key, fields);
+
+	return true;
+}
+
+template<unsigned int S>
 void
-WimshBwManagerFairRR::realPersistence (
+WimshBwManagerFairRR<S>::clearReservations (Plane p, unsigned int fs,
+		const std::vector<Row>& masks)
+{
+	// minislots which are common to all frames
+	Row common = masks[0];
+	for ( unsigned int i = 1 ; i < HORIZON ; i++ ) common &= masks[i];
+
+	for ( unsigned int m = common.firstOne (0, S) ; m < S ;
+			m = common.firstOne (m, S) ) {
+		const unsigned int e = common.firstZero (m, S);
+		slots_.mark (p, Slots::L_UGS, fs, HORIZON, m, e - m, false);
+		m = e;
+	}
+
+	for ( unsigned int i = 0 ; i < HORIZON ; i++ ) {
+		Row rest = masks[i];
+		rest.andNot (common);
+		for ( unsigned int m = rest.firstOne (0, S) ; m < S ;
+				m = rest.firstOne (m, S) ) {
+			const unsigned int e = rest.firstZero (m, S);
+			slots_.mark (p, Slots::L_UGS, fs + i, 1, m, e - m, false);
+			m = e;
+		}
+	}
+}
+
+template<unsigned int S>
+void
+WimshBwManagerFairRR<S>::realPersistence (
 		unsigned int start, WimshMshDsch::Persistence pers,
 		unsigned int& realStart, unsigned int& range)
 {
@@ -1920,8 +2314,9 @@ WimshBwManagerFairRR::realPersistence (
 	realStart = ( start >= mac_->frame() ) ? start : mac_->frame();
 }
 
+template<unsigned int S>
 WimshMshDsch::GntIE
-WimshBwManagerFairRR::grantFit (
+WimshBwManagerFairRR<S>::grantFit (
 		unsigned int ndx, unsigned int bytes,
 		unsigned int frame,
 		bool& room, bool& frame_room,
@@ -1949,259 +2344,353 @@ WimshBwManagerFairRR::grantFit (
 	// number of request slots
 	unsigned int nSlots = mac_->bytes2slots (ndx, bytes, true);
 
+	// minimum number of minislots of a grant
+	const unsigned int minSlots = minGrantSlots ();
+
 	// search the frame and first minislot available for grant
 	// set the actual frame number within the frame horizon
-	unsigned int F = (frame + 10) % HORIZON;
+	unsigned int F = (frame + grantStart (ndx, serv_class, frame)) % HORIZON;
+
+	// persistences to be tried, from the longest one
+	// UGS reservations always span the whole horizon
+	const WimshMshDsch::Persistence ladder[] = { persistence,
+		WimshMshDsch::FRAME8, WimshMshDsch::FRAME4,
+		WimshMshDsch::FRAME2, WimshMshDsch::FRAME1 };
+	const unsigned int nPers = ( serv_class == wimax::UGS ) ? 1 : 5;
 
 	// pick up a random channel, if required
 	unsigned int ch = 0;
 	if ( grantFitRandomChannel_ ) ch = grantFitRng.uniform ((int)C);
 
-	// nrtps pending slots
-	unsigned int count = 0;
+	// or start from the least loaded one
+	if ( grantFitLeastLoaded_ ) {
+		for ( unsigned int c = 1 ; c < C ; c++ )
+			if ( slots_.load (c, F) < slots_.load (ch, F) ) ch = c;
+	}
+
+	// get the bitsets which represent the grant unavailabilities (1 == unavailable, 0 == available)
+	// over the frames of each persistence, on each channel
+	grantFitWindow_.resize (C * nPers);
+	for ( unsigned int c = 0 ; c < C ; c++ )
+		window (ndx, c, frame, ladder, nPers, N, &grantFitWindow_[c * nPers]);
+
+	gnt.service_ = serv_class;
+	gnt.frame_ = frame;
+	gnt.fromRequester_ = false;
+
+	// as soon as a long enough range of minislots is free over the
+	// whole persistence, grant up to nSlots minislots of it
+	for ( unsigned int k = 0 ; k < nPers && nSlots >= minSlots ; k++ ) {
+		for ( unsigned int c = 0, chn = ch ; c < C ; c++, chn = ( chn + 1 ) % C ) {
+			unsigned int range = 0;
+			const unsigned int s = place (grantFitWindow_[chn * nPers + k],
+					minSlots, nSlots, N, range);
+			if ( s < N ) {
+				gnt.persistence_ = ladder[k];
+				gnt.channel_ = chn;
+				gnt.start_ = s;
+				gnt.range_ = range;
+				return gnt;
+			}
+		}
+	}
+
+	// frames over which minislots are borrowed, ie. the whole persistence
+	const unsigned int wnd = ( WimshMshDsch::pers2frames (persistence) < HORIZON ) ?
+		WimshMshDsch::pers2frames (persistence) : HORIZON;
 
 	// for each channel
 	for ( unsigned int c = 0 ; c < C ; c++ ) {
 
-		// get a bitset which represents the grant unavailabilities	(1 == unavailable, 0 == available)
-		std::bitset<MAX_SLOTS> map =
-		  unconfirmedSlots_[F] | unconfirmedSlots_UGS_[F] | unconfirmedSlots_NRTPS_[F] |
-		  busy_[F] | busy_UGS_[F] | busy_NRTPS_[F] |
-		  self_rx_unavl_[ch][F] | self_rx_unavl_UGS_[ch][F] | self_rx_unavl_NRTPS_[ch][F] |
-		  neigh_tx_unavl_[ndx][ch][F] | neigh_tx_unavl_UGS_[ndx][ch][F] | neigh_tx_unavl_NRTPS_[ndx][ch][F];
+		// minislots which are not free over the whole persistence
+		Row map = grantFitWindow_[ch * nPers];
 
-		// for each minislot in the current frame
-		for ( unsigned int s = 0 ; s < N ; s++ ) {
-			//if ( txBE_[F][serv] == false ) fprintf (stderr, "!!txBE_ = 0 tarma %d slot %d\n", frame ,s  );
+		gnt.service_ = serv_class;
+		gnt.frame_ = frame;
+		gnt.persistence_ = persistence;
+		gnt.fromRequester_ = false;
+		gnt.channel_ = ch;
 
-			// as soon as a free minislot is found, start the grant allocation
-			if ( map[s] == false ) {
+		unsigned int range = 0;
+		unsigned int s = N;
+
+		// frame is full
+		if ( serv_class == wimax::BE ) {
+			gnt.range_ = 0;
+			return gnt;
+		}
 
-				gnt.service_ = serv_class;
-				gnt.frame_ = frame;
+		// borrow bandwidth of BE and nrtPS services
+		// but attention to nrtPS minimum slots
+		Row borrow = borrowable (ndx, ch, frame, wnd, false);
+		borrow &= Row::range (0, N);
+		map.andNot (borrow);
+		const unsigned int count = borrow.count ();
+
+		if ( count > 0 ) {
+			s = ( nSlots >= minSlots ) ? place (map, minSlots, nSlots, N, range) : N;
+			if ( s < N ) {
 				gnt.start_ = s;
-				gnt.persistence_ = persistence;
-				gnt.fromRequester_ = false;
-				gnt.channel_ = ch;
+				gnt.range_ = range;
+				if ( WimaxDebug::trace("WBWM::grantFit") ) fprintf (stderr,
+						"%.9f WBWM::grantFit   [%d] range %d (%d-%d) frame %d\n",
+						NOW, mac_->nodeId(), gnt.range_, gnt.start_,
+						gnt.start_ + gnt.range_, frame);
 
-				// search for the largest minislot range
-				for ( ; s < N && map[s] == false &&
-					( s - gnt.start_ ) < nSlots ; s++ ) { }
+				WimshMshDsch::AvlIE avl;
+				avl.frame_ = gnt.frame_;
+				avl.start_ = gnt.start_;
+				avl.direction_ = WimshMshDsch::TX_AVL;
+				avl.persistence_ = persistence;
+				avl.channel_ = ch;
+				avl.service_ = (serv_class == wimax::UGS ) ? wimax::RTPS : serv_class; // TODO: if ugs then rtps?
+				avl.range_ = gnt.range_;
 
-				gnt.range_ = s - gnt.start_;
-				//if ( WimaxDebug::enabled() ) fprintf (stderr,
-				//		"gnt.range %d  %d-%d  frame .start_, s, frame);
+				if ( dsch->remaining() > WimshMshDsch::AvlIE::size() +
+						WimshMshDsch::GntIE::size() )
+					dsch->add (avl);
+				else {
+					if (serv_class == wimax::NRTPS )
+						availabilities_[0].push_back (avl);
+					else
+						availabilities_[1].push_back (avl);
 
-				// check the minimum number of OFDM symbols per grant
-				// unless the number of slots requested is smaller than that
-				unsigned int symbols =
-					  gnt.range_ * mac_->phyMib()->symPerSlot()
-					- mac_->phyMib()->symShortPreamble();
+					room = false;
+				}
 
-				if ( symbols < minGrant_ ) continue;
+				table_.set (Alloc::F_DST, frame, wnd, gnt.start_, gnt.range_, 999);
+				table_.set (Alloc::F_TX, frame, wnd, gnt.start_, gnt.range_, false);
+				table_.set (Alloc::F_SERVICE, frame, wnd, gnt.start_, gnt.range_, 9);
+				slots_.mark (slots_.unconfirmed (), Slots::L_DEF, frame, wnd, gnt.start_, gnt.range_, false);
+				slots_.mark (slots_.busy (), Slots::L_DEF, frame, wnd, gnt.start_, gnt.range_, false);
+				slots_.mark (slots_.selfRx (ch), Slots::L_DEF, frame, wnd, gnt.start_, gnt.range_, false);
+				slots_.mark (slots_.neighTx (ndx, ch), Slots::L_DEF, frame, wnd, gnt.start_, gnt.range_, false);
 
 				return gnt;
 			}
 
-			// frame is full
-			if ( s == N - 1 ) {
-//				if ( WimaxDebug::enabled() ) fprintf (stderr,
-//						"!1frame totalmente ocupada %d ultimo s %d \n", frame, s);
-				if ( serv_class == wimax::BE ) {
-					gnt.range_ = 0;
-					//if ( WimaxDebug::enabled() ) fprintf (stderr,
-					//		"!2 BE: frame totalmente ocupada %d ultimo s %d \n", frame, s);
-					return gnt;
+		} else if ( serv_class == wimax::NRTPS || serv_class == wimax::RTPS ) {
 
-				} else {
+			if (serv_class == wimax::NRTPS && nSlots > nrtpsMinSlots_ ) nSlots = nrtpsMinSlots_;
+			frame_room = false;
 
-					// for each minislot in the current frame
-					for ( unsigned int m = 0 ; m < N ; m++ ) {
-
-						// borrow bandwidth of BE and nrtPS services
-						// but attention to nrtPS minimum slots
-						if ( service_[F][m] == 9 || service_[F][m] == wimax::BE ||
-								(service_[F][m] == wimax::NRTPS &&
-										!(( unconfirmedSlots_NRTPS_[F][m] ||
-												busy_NRTPS_[F][m] || self_rx_unavl_NRTPS_[ch][F][m] ||
-												neigh_tx_unavl_NRTPS_[ndx][ch][F][m]))) ) {
-							map[m] = false;
-							count++;
-						}
-					}
+			// borrow bandwidth from UGS reservations
+			const Row ugs = ~borrowable (ndx, ch, frame, wnd, true);
 
-					if (count > 0)
-					{
-						for ( unsigned int r = 0 ; r < N ; r++ ) {
-
-							// as soon as a  service_[F][m] == 9 || free minislot is found, start the grant allocation
-							if ( map[r] == false ) {
-
-								gnt.service_ = serv_class;
-								gnt.frame_ = frame;
-								gnt.start_ = r;
-								gnt.persistence_ = persistence;
-								gnt.fromRequester_ = false;
-								gnt.channel_ = ch;
-
-								// search for the largest minislot range
-								for ( ; r < N && map[r] == false &&
-									( r - gnt.start_ ) < nSlots ; r++ ) { }
-
-								gnt.range_ = r - gnt.start_;
-								if ( WimaxDebug::trace("WBWM::grantFit") ) fprintf (stderr,
-										"%.9f WBWM::grantFit   [%d] range %d (%d-%d) frame %d\n",
-										NOW, mac_->nodeId(), gnt.range_, gnt.start_, r, frame);
-
-								unsigned int symbols =
-									gnt.range_ * mac_->phyMib()->symPerSlot()
-										- mac_->phyMib()->symShortPreamble();
-
-								if ( symbols < minGrant_ ) continue;
-
-								WimshMshDsch::AvlIE avl;
-								avl.frame_ = gnt.frame_;
-								avl.start_ = gnt.start_;
-								avl.direction_ = WimshMshDsch::TX_AVL;
-								avl.persistence_ = WimshMshDsch::FRAME128;
-								avl.channel_ = ch;
-								avl.service_ = (serv_class == wimax::UGS ) ? wimax::RTPS : serv_class; // TODO: if ugs then rtps?
-								avl.range_ = gnt.range_;
-
-								if ( dsch->remaining() > WimshMshDsch::AvlIE::size() +
-										WimshMshDsch::GntIE::size() )
-									dsch->add (avl);
-								else {
-									if (serv_class == wimax::NRTPS )
-										availabilities_[0].push_back (avl);
-									else
-										availabilities_[1].push_back (avl);
-
-									room = false;
-								}
-
-								setSlots (dst_, frame, 128, gnt.start_, gnt.range_, 999);
-								setSlots (grants_, frame, 128, gnt.start_, gnt.range_, false);
-								setSlots (service_, frame, 128, gnt.start_, gnt.range_, 9);
-								setSlots (unconfirmedSlots_, frame, 128, gnt.start_, gnt.range_, false);
-								setSlots (busy_, frame, 128, gnt.start_, gnt.range_, false);
-								setSlots (self_rx_unavl_[ch], frame, 128, gnt.start_, gnt.range_, false);
-								setSlots (neigh_tx_unavl_[ndx][ch], frame, 128, gnt.start_, gnt.range_, false);
-
-								//if ( WimaxDebug::enabled() ) fprintf (stderr,
-								//		"2sai do grantFit  gnt.range %d frame %d\n", gnt.range_, frame);
-								return gnt;
-							}
-					}
-					} else {
-						if (serv_class == wimax::NRTPS || serv_class == wimax::RTPS) {
-
-							if (serv_class == wimax::NRTPS && nSlots > nrtpsMinSlots_ ) nSlots = nrtpsMinSlots_;
-							frame_room = false;
-
-							for ( unsigned int r = 0 ; r < N ; r++ ) {
-
-								// as soon as a free minislot is found, start the grant allocation
-								if ( service_[F][r] == wimax::UGS) {
-
-									gnt.service_ = serv_class;
-									gnt.frame_ = frame;
-									gnt.start_ = r;
-									gnt.persistence_ = persistence;
-									gnt.fromRequester_ = false;
-									gnt.channel_ = ch;
-
-									// search for the largest minislot range
-									for ( ; r < N && service_[F][r] == wimax::UGS &&
-										 ( r - gnt.start_ ) < nSlots ; r++ ) { }
-
-									gnt.range_ = r - gnt.start_;
-//									if ( WimaxDebug::enabled() ) fprintf (stderr,
-//										"2gnt.range %d  %d-%d  frame %d\n", gnt.range_, gnt.start_, r, frame);
-
-									unsigned int symbols =
-										gnt.range_ * mac_->phyMib()->symPerSlot()
-										- mac_->phyMib()->symShortPreamble();
-
-									if ( symbols < minGrant_ ) continue;
-
-									WimshMshDsch::AvlIE avl;
-									avl.frame_ = gnt.frame_;
-									avl.start_ = gnt.start_;
-									avl.direction_ = WimshMshDsch::TX_AVL;
-									avl.persistence_ = WimshMshDsch::FRAME128;
-									avl.channel_ = ch;
-									avl.service_ = serv_class;
-									avl.range_ = gnt.range_;
-
-									if ( dsch->remaining() > WimshMshDsch::AvlIE::size() + WimshMshDsch::GntIE::size() )
-										dsch->add (avl);
-									else {
-										if (serv_class == wimax::NRTPS )
-											availabilities_[0].push_back (avl);
-										else
-											availabilities_[1].push_back (avl);
-										room = false;
-									}
-
-									setSlots (dst_, frame, 128, gnt.start_, gnt.range_, 999);
-									setSlots (grants_, frame, 128, gnt.start_, gnt.range_, false);
-									setSlots (service_, frame, 128, gnt.start_, gnt.range_, 9);
-									setSlots (unconfirmedSlots_UGS_, frame, 128, gnt.start_, gnt.range_, false);
-									setSlots (busy_UGS_, frame, 128, gnt.start_, gnt.range_, false);
-									setSlots (self_rx_unavl_UGS_[ch], frame, 128, gnt.start_, gnt.range_, false);
-									setSlots (neigh_tx_unavl_UGS_[ndx][ch], frame, 128, gnt.start_, gnt.range_, false);
-
-									//if ( WimaxDebug::enabled() ) fprintf (stderr,
-									//		"2sai do grantFit  gnt.range %d frame %d\n", gnt.range_, frame);
-									return gnt;
-								}
-						}
+			s = ( nSlots >= minSlots ) ? place (ugs, minSlots, nSlots, N, range) : N;
+			if ( s < N ) {
+				gnt.start_ = s;
+				gnt.range_ = range;
 
-					}
-					}
+				WimshMshDsch::AvlIE avl;
+				avl.frame_ = gnt.frame_;
+				avl.start_ = gnt.start_;
+				avl.direction_ = WimshMshDsch::TX_AVL;
+				avl.persistence_ = persistence;
+				avl.channel_ = ch;
+				avl.service_ = serv_class;
+				avl.range_ = gnt.range_;
+
+				if ( dsch->remaining() > WimshMshDsch::AvlIE::size() + WimshMshDsch::GntIE::size() )
+					dsch->add (avl);
+				else {
+					if (serv_class == wimax::NRTPS )
+						availabilities_[0].push_back (avl);
+					else
+						availabilities_[1].push_back (avl);
+					room = false;
 				}
+
+				table_.set (Alloc::F_DST, frame, wnd, gnt.start_, gnt.range_, 999);
+				table_.set (Alloc::F_TX, frame, wnd, gnt.start_, gnt.range_, false);
+				table_.set (Alloc::F_SERVICE, frame, wnd, gnt.start_, gnt.range_, 9);
+				slots_.mark (slots_.unconfirmed (), Slots::L_UGS, frame, wnd, gnt.start_, gnt.range_, false);
+				slots_.mark (slots_.busy (), Slots::L_UGS, frame, wnd, gnt.start_, gnt.range_, false);
+				slots_.mark (slots_.selfRx (ch), Slots::L_UGS, frame, wnd, gnt.start_, gnt.range_, false);
+				slots_.mark (slots_.neighTx (ndx, ch), Slots::L_UGS, frame, wnd, gnt.start_, gnt.range_, false);
+				dropReservations (wimax::UGS, gnt.start_, gnt.range_);
+
+				return gnt;
 			}
-		} // for each minislot
+		}
 
 		// set the actual channel number
 		ch = ( ch + 1 ) % C;
 
 	} // for each channel
-	//if ( WimaxDebug::enabled() ) fprintf (stderr, "!2frame totalmente ocupada %d\n", f);
 
 	gnt.range_ = 0;
-//	if ( WimaxDebug::enabled() ) fprintf (stderr, "!3 final do grantfit \n");
 	return gnt;
 }
 
+template<unsigned int S>
+unsigned int
+WimshBwManagerFairRR<S>::place (const Row& map,
+		unsigned int minSlots, unsigned int nSlots, unsigned int N,
+		unsigned int& range)
+{
+	// first minislot and length of the selected run of free minislots
+	unsigned int best = N;
+	unsigned int bestLen = 0;
+
+	switch ( grantFitPlacement_ ) {
+	case FIT_FIRST:
+		best = map.findZeroRun (minSlots, 0, N);
+		if ( best < N ) bestLen = map.zeroRun (best, N);
+		break;
+
+	case FIT_NEXT:
+		// start from where the last grant ended, then wrap around
+		best = map.findZeroRun (minSlots, ( grantFitNext_ < N ) ? grantFitNext_ : 0, N);
+		if ( best == N ) best = map.findZeroRun (minSlots, 0, N);
+		if ( best < N ) bestLen = map.zeroRun (best, N);
+		break;
+
+	case FIT_BEST:
+	case FIT_END:
+		// visit all the runs of free minislots
+		for ( unsigned int s = map.firstZero (0, N) ; s < N ;
+				s = map.firstZero (s, N) ) {
+			const unsigned int len = map.zeroRun (s, N);
+			if ( len >= minSlots ) {
+				if ( grantFitPlacement_ == FIT_END ) {
+					best = s; bestLen = len;
+
+				// the shortest run which is long enough, otherwise the longest one
+				} else if ( best == N ||
+						( len >= nSlots && ( bestLen < nSlots || len < bestLen ) ) ||
+						( len < nSlots && bestLen < nSlots && len > bestLen ) ) {
+					best = s; bestLen = len;
+				}
+			}
+			s += len;
+		}
+		break;
+	}
+
+	if ( best == N ) return N;
+
+	range = ( bestLen < nSlots ) ? bestLen : nSlots;
+
+	// align the grant to the end of the run
+	if ( grantFitPlacement_ == FIT_END ) best += bestLen - range;
+
+	grantFitNext_ = best + range;
+	return best;
+}
+
+template<unsigned int S>
 void
-WimshBwManagerFairRR::realGrantStart (
+WimshBwManagerFairRR<S>::window (unsigned int ndx, unsigned int ch, unsigned int frame,
+		const WimshMshDsch::Persistence* ladder, unsigned int nPers,
+		unsigned int N, Row* maps)
+{
+	// minislots unavailable in any of the frames visited so far
+	Row map;
+	bool full = false;
+
+	unsigned int n = 0;
+	for ( unsigned int k = nPers ; k-- > 0 ; ) {
+		const unsigned int frames = WimshMshDsch::pers2frames (ladder[k]);
+		for ( ; n < frames && n < HORIZON && ! full ; n++ ) {
+			map |= slots_.eligible (ndx, ch, frame + n);
+			full = ( map.firstZero (0, N) == N );
+		}
+		maps[k] = map;
+	}
+}
+
+template<unsigned int S>
+typename WimshBwManagerFairRR<S>::Row
+WimshBwManagerFairRR<S>::borrowable (unsigned int ndx, unsigned int ch,
+		unsigned int frame, unsigned int frames, bool ugs)
+{
+	Alloc::Run key;
+	Row map = ~Row ();
+
+	for ( unsigned int n = 0 ; n < frames && map.any () ; n++ ) {
+		const unsigned int f = frame + n;
+		Row borrow;
+		if ( ugs ) {
+			key.service_ = wimax::UGS;
+			borrow = match (f, key, Alloc::F_SERVICE);
+		} else {
+			// minislots reserved to the nrtPS minimum guarantee
+			const Row nrtps =
+				slots_.row (slots_.unconfirmed (), Slots::L_NRTPS, f) |
+				slots_.row (slots_.busy (), Slots::L_NRTPS, f) |
+				slots_.row (slots_.selfRx (ch), Slots::L_NRTPS, f) |
+				slots_.row (slots_.neighTx (ndx, ch), Slots::L_NRTPS, f);
+
+			key.service_ = Alloc::NO_SERVICE;
+			borrow = match (f, key, Alloc::F_SERVICE);
+			key.service_ = wimax::BE;
+			borrow |= match (f, key, Alloc::F_SERVICE);
+			key.service_ = wimax::NRTPS;
+			borrow |= match (f, key, Alloc::F_SERVICE).andNot (nrtps);
+		}
+		map &= borrow;
+	}
+	return map;
+}
+
+template<unsigned int S>
+void
+WimshBwManagerFairRR<S>::fragmentation (unsigned int F)
+{
+	const unsigned int N = mac_->phyMib()->slotPerFrame();
+
+	// minislots of the frame which are not used by this node
+	const Row map =
+		slots_.any (slots_.busy (), F) | slots_.any (slots_.unconfirmed (), F);
+
+	unsigned int runs = 0;
+	unsigned int largest = 0;
+	for ( unsigned int s = map.firstZero (0, N) ; s < N ; s = map.firstZero (s, N) ) {
+		const unsigned int len = map.zeroRun (s, N);
+		if ( len > largest ) largest = len;
+		++runs;
+		s += len;
+	}
+
+	Stat::put ("wimsh_free_runs_a", mac_->index(), runs);
+	Stat::put ("wimsh_free_max_a", mac_->index(), largest);
+}
+
+template<unsigned int S>
+void
+WimshBwManagerFairRR<S>::realGrantStart (
 		unsigned int ndx, unsigned int gframe, unsigned char gstart,
 		unsigned char grange, unsigned char gchannel, WimshMshDsch::GntIE& gnt)
 {
 	unsigned int F;
 	unsigned int c = 0;
-	unsigned int s;
-	std::bitset<MAX_SLOTS> map;
+	Row map;
+
+	// minislots of the grant
+	const Row gmask = Row::range (gstart, grange);
 
+	// the nrtPS minimum slots are not considered
+	const unsigned int layers = Slots::M_DEF | Slots::M_UGS;
 
+	// the grant may start as late as this
+	const unsigned int offset = grantStart (ndx, gnt.service_, gframe);
 
-	for ( unsigned int f = gframe ; f < gframe + 10 ; f++ ) {
+	for ( unsigned int f = gframe ; f < gframe + offset ; f++ ) {
 		F = f % HORIZON;
 
 		map =
-			unconfirmedSlots_[F] | unconfirmedSlots_UGS_[F] |
-			busy_[F] | busy_UGS_[F] |
-			self_rx_unavl_[gchannel][F] | self_rx_unavl_UGS_[gchannel][F] |
-			neigh_tx_unavl_[ndx][gchannel][F] | neigh_tx_unavl_UGS_[ndx][gchannel][F];
+			slots_.any (slots_.unconfirmed (), F, layers) |
+			slots_.any (slots_.busy (), F, layers) |
+			slots_.any (slots_.selfRx (gchannel), F, layers) |
+			slots_.any (slots_.neighTx (ndx, gchannel), F, layers);
 
-		for ( s = gstart ; s < (gstart + grange) && map[s] == false ; s++ ) { }
-		//if ( WimaxDebug::enabled() ) fprintf (stderr, "s %d\n",s);
+		// check whether all the granted minislots are available in this frame
+		map &= gmask;
 		if ( WimaxDebug::trace("WBWM::realGrantStart") ) fprintf (stderr,
-				"\trealGrantStart s %d\n", s);
+				"\trealGrantStart s %d\n", map.firstOne (gstart, gstart + grange));
 
-		if ( s == (gstart + grange) ) {
+		if ( map.none() ) {
 			gnt.frame_ = gframe + c;
 			//if ( WimaxDebug::enabled() ) fprintf (stderr, "realGrantStart gnt.frame_ %d\n",gnt.frame_);
 			if ( WimaxDebug::trace("WBWM::realGrantStart") ) fprintf (stderr,
@@ -2211,30 +2700,58 @@ WimshBwManagerFairRR::realGrantStart (
 			c++;
 	}
 //	if ( WimaxDebug::enabled() ) fprintf (stderr, "mais 10 gnt.frame_ %d\n",gnt.frame_);
-	gnt.frame_ = gframe + 10;
+	gnt.frame_ = gframe + offset;
 }
 
+template<unsigned int S>
 void
-WimshBwManagerFairRR::confFit (
+WimshBwManagerFairRR<S>::confFit (
 		unsigned int f, unsigned int mstart,
 		unsigned int mrange, WimshMshDsch::GntIE& gnt, bool& room,
 		unsigned int serv_class, WimshMshDsch* dsch)
 {
-	WimshMshDsch::Persistence persistence;
-	if ( serv_class == wimax::UGS ) persistence = WimshMshDsch::frames2pers(HORIZON);
-	else persistence = WimshMshDsch::frames2pers(HORIZON / 4);
+	// the confirmation keeps the persistence of the grant, which
+	// may be shorter than the default one
+	const WimshMshDsch::Persistence persistence = gnt.persistence_;
+
+	unsigned int F = (f + grantStart (gnt.nodeId_)) % HORIZON;
+
+	const unsigned int layers = Slots::M_DEF | Slots::M_UGS;
+	Row map =
+		slots_.any (slots_.busy (), F, layers) |
+		slots_.any (slots_.selfTx (gnt.channel_), F, layers);
 
-	unsigned int F = (f + 10) % HORIZON;
+	// minislots reserved to the nrtPS minimum guarantee
+	const Row nrtps =
+		slots_.row (slots_.busy (), Slots::L_NRTPS, F) |
+		slots_.row (slots_.selfTx (gnt.channel_), Slots::L_NRTPS, F);
+
+	// as soon as a free minislot is found, start the grant allocation
+	unsigned int s = map.firstZero (mstart, mstart + mrange);
+	if ( s < mstart + mrange ) {
+
+		//gnt.service_ = serv_class;
+		gnt.frame_ = f;
+		gnt.start_ = s;
+		gnt.persistence_ = persistence;
+
+		// search for the largest minislot range
+		gnt.range_ = map.zeroRun (s, mstart + mrange);
+		return;
+	}
 
-	std::bitset<MAX_SLOTS> map =
-		busy_[F] | busy_UGS_[F] |
-		self_tx_unavl_[gnt.channel_][F] | self_tx_unavl_UGS_[gnt.channel_][F];
+	// grant range is full
+	if ( mrange > 0 && serv_class == wimax::NRTPS ) {
 
-	// for each minislot in the current frame
-	for ( unsigned int s = mstart ; s < mstart + mrange ; s++ ) {
+		// borrow bandwidth from nrtPS slots // TODO: review
+		Alloc::Run key;
+		key.service_ = wimax::NRTPS;
+		Row borrow = match (F, key, Alloc::F_SERVICE).andNot (nrtps);
+		map.andNot ( borrow &= Row::range (mstart, mrange) );
 
 		// as soon as a free minislot is found, start the grant allocation
-		if ( map[s] == false ) {
+		s = map.firstZero (mstart, mstart + mrange);
+		if ( s < mstart + mrange ) {
 
 			//gnt.service_ = serv_class;
 			gnt.frame_ = f;
@@ -2242,70 +2759,40 @@ WimshBwManagerFairRR::confFit (
 			gnt.persistence_ = persistence;
 
 			// search for the largest minislot range
-			for ( ; s < ( mstart + mrange ) && map[s] == false ; s++ ) { }
-
-			gnt.range_ = s - gnt.start_;
-			return;
-		}
-
-		// grant range is full
-		if ( s == (mstart + mrange - 1) && serv_class == wimax::NRTPS ) {
-//				if ( WimaxDebug::enabled() ) fprintf (stderr,
-//				"!1frame totalmente ocupada \n");
-			for ( unsigned int s = mstart ; s < mstart + mrange ; s++ ) {
-
-				// borrow bandwidth from nrtPS slots // TODO: review
-				map[s] = ( service_[F][s] == wimax::NRTPS && ! busy_NRTPS_[F][s] &&
-							! self_tx_unavl_NRTPS_[gnt.channel_][F][s] ) ? false : map[s];
-			}
-
-			for ( unsigned int s = mstart ; s < mstart + mrange ; s++ ) {
-
-				// as soon as a free minislot is found, start the grant allocation
-				if ( map[s] == false ) {
+			gnt.range_ = map.zeroRun (s, mstart + mrange);
 
-					//gnt.service_ = serv_class;
-					gnt.frame_ = f;
-					gnt.start_ = s;
-					gnt.persistence_ = persistence;
+			if ( WimaxDebug::trace("WBWM::confFit") ) fprintf (stderr,
+					"%.9f WBWM::confFit    [%d] grant range %d (%d-%d) frame %d\n",
+					NOW, mac_->nodeId(), gnt.range_, gnt.start_,
+					gnt.start_ + gnt.range_, f);
 
-					// search for the largest minislot range
-					for ( ; s < ( mstart + mrange ) && map[s] == false ; s++ ) { }
-
-					gnt.range_ = s - gnt.start_;
-
-					if ( WimaxDebug::trace("WBWM::confFit") ) fprintf (stderr,
-							"%.9f WBWM::confFit    [%d] grant range %d (%d-%d) frame %d\n",
-							NOW, mac_->nodeId(), gnt.range_, gnt.start_, s, f);
-
-					WimshMshDsch::AvlIE avl;
-					avl.frame_ = gnt.frame_;
-					avl.start_ = gnt.start_;
-					avl.direction_ = WimshMshDsch::RX_AVL;
-					avl.persistence_ = WimshMshDsch::FRAME32;
-					avl.channel_ = gnt.channel_;
-					avl.service_ = (serv_class == wimax::UGS ) ? wimax::RTPS : serv_class;
-					avl.range_ = gnt.range_;
-
-					if ( dsch->remaining() > WimshMshDsch::AvlIE::size() +
-							WimshMshDsch::GntIE::size() )
-						dsch->add (avl);
-					else {
-						availabilities_[0].push_back (avl);
-						room = false;
-					}
-					return;
-				}
+			WimshMshDsch::AvlIE avl;
+			avl.frame_ = gnt.frame_;
+			avl.start_ = gnt.start_;
+			avl.direction_ = WimshMshDsch::RX_AVL;
+			avl.persistence_ = WimshMshDsch::FRAME32;
+			avl.channel_ = gnt.channel_;
+			avl.service_ = (serv_class == wimax::UGS ) ? wimax::RTPS : serv_class;
+			avl.range_ = gnt.range_;
+
+			if ( dsch->remaining() > WimshMshDsch::AvlIE::size() +
+					WimshMshDsch::GntIE::size() )
+				dsch->add (avl);
+			else {
+				availabilities_[0].push_back (avl);
+				room = false;
 			}
+			return;
 		}
-	} // for each minislot
+	}
 
 	// if we reach this point, then it is not possible to grant bandwidth
 	gnt.range_ = 0;  // in this case, the other fields are not meaningful
 }
 
+template<unsigned int S>
 void
-WimshBwManagerFairRR::backlog (WimaxNodeId src, WimaxNodeId dst,
+WimshBwManagerFairRR<S>::backlog (WimaxNodeId src, WimaxNodeId dst,
 		unsigned char prio, WimaxNodeId nexthop, unsigned int bytes)
 {
 	// add the current flow to the weight manager data structure
@@ -2320,13 +2807,15 @@ WimshBwManagerFairRR::backlog (WimaxNodeId src, WimaxNodeId dst,
 						( prio == 4 || prio == 5 ) ? 2 : 3 ;
 	// add the amount of received bytes to the backlog of this output link
 	neigh_[ndx][s].backlog_ += bytes;
+	handshakeStage (ndx, s, HS_BACKLOG);
 
 	if ( WimaxDebug::trace("WBWM::backlog") ) fprintf (stderr,
 			"%.9f WBWM::backlog    [%d] prio %d serv %d ndx %i\n", NOW, mac_->nodeId(), prio, s, ndx);
 }
 
+template<unsigned int S>
 void
-WimshBwManagerFairRR::backlog (WimaxNodeId nexthop, unsigned int bytes, unsigned int serv)
+WimshBwManagerFairRR<S>::backlog (WimaxNodeId nexthop, unsigned int bytes, unsigned int serv)
 {
 	// add the current flow to the weight manager data structure
 	wm_.flow (mac_->neigh2ndx(nexthop), wimax::OUT);
@@ -2336,20 +2825,62 @@ WimshBwManagerFairRR::backlog (WimaxNodeId nexthop, unsigned int bytes, unsigned
 
 	// add the amount of received bytes to the backlog of this output link
 	neigh_[ndx][serv].backlog_ += bytes;
+	handshakeStage (ndx, serv, HS_BACKLOG);
 }
 
+template<unsigned int S>
 void
-WimshBwManagerFairRR::sent (WimaxNodeId nexthop, unsigned int bytes, unsigned int serv)
+WimshBwManagerFairRR<S>::sent (WimaxNodeId nexthop, unsigned int bytes, unsigned int serv)
 {
 	// get the index of the nexthop neighbor (ie. the link identifier)
 	const unsigned int ndx = mac_->neigh2ndx(nexthop);
 
 	// remove the amount of received bytes from the backlog of this output link
 	neigh_[ndx][serv].backlog_ -= bytes;
+	handshakeStage (ndx, serv, HS_USE);
 }
 
+template<unsigned int S>
 void
-WimshBwManagerFairRR::searchTXslot (unsigned int ndx, unsigned int reqState)
+WimshBwManagerFairRR<S>::handshakeStage (unsigned int ndx, unsigned int serv,
+		HandshakeStage stage)
+{
+	static const char* stat[] = { "", "wimsh_hs_request_d", "wimsh_hs_grant_d",
+		"wimsh_hs_confirm_d", "wimsh_hs_use_d" };
+
+	double* t = neigh_[ndx][serv].hs_;
+
+	if ( stage == HS_BACKLOG ) {
+		if ( t[HS_BACKLOG] < 0 ) t[HS_BACKLOG] = NOW;
+		return;
+	}
+
+	// skip the stages reached out of order, or more than once
+	if ( t[stage - 1] < 0 || ( stage < HS_USE && t[stage] >= 0 ) ) return;
+
+	Stat::put (stat[stage], mac_->index(), NOW - t[stage - 1]);
+
+	if ( stage < HS_USE ) {
+		t[stage] = NOW;
+	} else {
+		Stat::put ("wimsh_hs_total_d", mac_->index(), NOW - t[HS_BACKLOG]);
+		for ( unsigned int i = 0 ; i < HS_USE ; i++ ) t[i] = -1;
+	}
+}
+
+template<unsigned int S>
+void
+WimshBwManagerFairRR<S>::unused (WimaxNodeId nexthop, unsigned int bytes, unsigned int serv)
+{
+	// get the index of the nexthop neighbor (ie. the link identifier)
+	const unsigned int ndx = mac_->neigh2ndx(nexthop);
+
+	neigh_[ndx][serv].unused_ += bytes;
+}
+
+template<unsigned int S>
+void
+WimshBwManagerFairRR<S>::searchTXslot (unsigned int ndx, unsigned int reqState)
 {
 	unsigned int fstart = mac_->frame(), // the current frame number
 				 N = mac_->phyMib()->slotPerFrame(), // number of minislots per frame
@@ -2373,24 +2904,21 @@ WimshBwManagerFairRR::searchTXslot (unsigned int ndx, unsigned int reqState)
 			fprintf (stderr, "\tFrame %d:\n", f);
 
 		// obtain a bitset map of all slots unavailable for transmision
-		const std::bitset<MAX_SLOTS> map =
-				busy_[F] | busy_UGS_[F] | self_tx_unavl_[0][F] | self_tx_unavl_UGS_[0][F];
+		const Row map =
+				slots_.any (slots_.busy (), F, Slots::M_DEF | Slots::M_UGS) |
+				slots_.any (slots_.selfTx (0), F, Slots::M_DEF | Slots::M_UGS);
 
 		// evaluate how many slots are already reserved for uncoord DSCHs
-		unsigned markedForDSCH = 0;
-		for(unsigned i = 0; i < N; i++)
-			if ( uncoordsch_[F][i] != UINT_MAX )
-				markedForDSCH++;
+		Alloc::Run key;
+		unsigned markedForDSCH = N - match (F, key, Alloc::F_UNCOORD).count (0, N);
 
 		if(markedForDSCH != 0)
 			if ( WimaxDebug::trace("WBWM::searchTXslot") )
 				fprintf (stderr, "\t\t%d slots already marked for uncoord DSCH\n", markedForDSCH);
 
 		// check if there already are slots marked for uncoord DSCH to this node
-		unsigned dschSlots = 0;
-		for(unsigned i = 0; i < N; i++)
-			if ( uncoordsch_[F][i] == dst )
-				dschSlots++;
+		key.uncoord_ = dst;
+		unsigned dschSlots = match (F, key, Alloc::F_UNCOORD).count (0, N);
 
 		if (dschSlots != 0)
 			if ( WimaxDebug::trace("WBWM::searchTXslot") )
@@ -2402,42 +2930,33 @@ WimshBwManagerFairRR::searchTXslot (unsigned int ndx, unsigned int reqState)
 		 * Try to find nslots starting at the end of the frame, where it's most likely to find free slots
 		 * and not interfere with other allocations
 		 */
-		signed int s; 	// need signed to detect going beyond 0
+		/* collision avoidance
+		 * this is a very crude modification to stop neighbor nodes from colliding
+		 * in rtPS reservations; basically it offsets the beginning of the search
+		 * by nslots*nodeid (modulo the frame size)
+		 */
+		const unsigned int top = N - ( nslots * nodeid ) % N;
 
 		// locate the first free slot, going from finish to start
-			// normal
-//			for ( s = N-1 ; map[s] == true && (unsigned)s >= (nslots-1) ; s--);
+		const unsigned int last = map.lastZero (0, top);
 
-			/* collision avoidance
-			 * this is a very crude modification to stop neighbor nodes from colliding
-			 * in rtPS reservations; basically it offsets the beginning of the search
-			 * by nslots*nodeid
-			 */
-			for ( s = N-1-(nslots*nodeid) ; map[s] == true && (unsigned)s >= (nslots-1) ; s--);
-
-
-		// if we didn't hit the start of the frame, try to find nslots free for us to use
-		if( s != (signed)(nslots-2) ) {
-			unsigned freeSlots=0;
-			for( ; map[s] == false && s >= 0 && freeSlots < nslots ; s--)
-				freeSlots++;
-
-			// if we got what we needed, mark the slots for an uncoord DSCH and leave
-			if( freeSlots == nslots ) {
-				// aliases
-				unsigned mstart = (unsigned)s;	// if we're here then s is >0
-				unsigned &mrange = nslots;
+		// if we didn't hit the start of the frame, check whether the nslots
+		// ending with that slot are free for us to use
+		if ( nslots > 0 && last < top && last + 1 >= nslots &&
+				map.lastOne (last + 1 - nslots, last + 1) == last + 1 ) {
+			// aliases
+			unsigned mstart = last + 1 - nslots;
+			unsigned &mrange = nslots;
 
-				if ( WimaxDebug::trace("WBWM::searchTXslot") )
-					fprintf (stderr, "\t\trange [%d:%d] is free, marking for uncoord DSCH to %d\n", mstart, mstart+mrange, dst);
+			if ( WimaxDebug::trace("WBWM::searchTXslot") )
+				fprintf (stderr, "\t\trange [%d:%d] is free, marking for uncoord DSCH to %d\n", mstart, mstart+mrange, dst);
 
-				setSlots (uncoordsch_, 	f, 1, mstart, mrange, dst);
-//				setSlots (grants_, 		f, 1, mstart, mrange, true);
-				setSlots (busy_, 		f, 1, mstart, mrange, true);
-				setSlots (self_tx_unavl_[0], f, 1, mstart, mrange, true);
+			table_.set (Alloc::F_UNCOORD, 	f, 1, mstart, mrange, dst);
+//			table_.set (Alloc::F_TX, 		f, 1, mstart, mrange, true);
+			slots_.mark (slots_.busy (), Slots::L_DEF, f, 1, mstart, mrange, true);
+			slots_.mark (slots_.selfTx (0), Slots::L_DEF, f, 1, mstart, mrange, true);
 
-				return;
-			}
+			return;
 		}
 
 		/*
@@ -2450,26 +2969,25 @@ WimshBwManagerFairRR::searchTXslot (unsigned int ndx, unsigned int reqState)
 
 		if ( reqState == 0 ) {
 			// evaluate how many slots are reserved for rtPS in this frame
-			unsigned int rtPSslots = 0;
-			for ( unsigned int i = 0 ; i < N ; i++ )
-				if ( dst_[F][i] == dst && service_[F][i] == wimax::RTPS )
-					rtPSslots++;
+			key.dst_ = dst;
+			key.service_ = wimax::RTPS;
+			const Row rtps = match (F, key, Alloc::F_DST | Alloc::F_SERVICE);
+			unsigned int rtPSslots = rtps.count (0, N);
 
 			// if there are enough slots
 			if( rtPSslots >= nslots) {
 				// find a starting point, finish to start again
-				signed int s;
-				for( s = N-1 ; (dst_[F][s] != dst || service_[F][s] != wimax::RTPS) && s >=0; s--);
+				signed int s = rtps.lastOne (0, N);
 
 				// caution: this assumes the first reservation we find is size nslots
 				unsigned mstart = (s+1) - nslots; // TODO panic if nslots > s
 				unsigned &mrange = nslots;
 
 				// use those slots
-				setSlots (uncoordsch_, 	f, 1, mstart, mrange, dst);
-//				setSlots (grants_, 		f, 1, mstart, mrange, true);
-				setSlots (busy_, 		f, 1, mstart, mrange, true);
-				setSlots (self_tx_unavl_[0], f, 1, mstart, mrange, true);
+				table_.set (Alloc::F_UNCOORD, 	f, 1, mstart, mrange, dst);
+//				table_.set (Alloc::F_TX, 		f, 1, mstart, mrange, true);
+				slots_.mark (slots_.busy (), Slots::L_DEF, f, 1, mstart, mrange, true);
+				slots_.mark (slots_.selfTx (0), Slots::L_DEF, f, 1, mstart, mrange, true);
 
 				if ( WimaxDebug::trace("WBWM::searchTXslot") )
 					fprintf (stderr, "\t\trange [%d:%d] borrowed from rtPS reservations\n", mstart, mstart+mrange);
@@ -2493,38 +3011,29 @@ WimshBwManagerFairRR::searchTXslot (unsigned int ndx, unsigned int reqState)
 			// we already tried rtPS
 			if ( serv == wimax::RTPS ) continue;
 
-			// for each minislot in the current frame
-			for ( unsigned int i = 0 ; i < N ; i++ ) {
-				// find and mark slots to transmit MSH-DSCH message
-				if ( 	grants_[F][i] == true &&
-						service_[F][i] == serv &&
-						uncoordsch_[F][i] != dst ) {
-
-					// pick this slot number
-					unsigned int mstart = i;
+			// slots granted to this service, not marked for uncoord DSCH to dst yet
+			// (ie. unavailable slots are set)
+			key.tx_ = true;
+			key.service_ = serv;
+			Row avl = ~match (F, key, Alloc::F_TX | Alloc::F_SERVICE);
+			avl |= match (F, key, Alloc::F_UNCOORD);
 
-					// move 'i' forward up to 'nslots' while each slot is granted and assigned to the same service
-					for ( ; i < (mstart + nslots) &&
-							i < N &&
-							grants_[F][i] == true &&
-							service_[F][i] == serv &&
-							uncoordsch_[F][i] != dst ; i++ );
+			// find the first range of nslots such slots
+			const unsigned int mstart = avl.findZeroRun (nslots, 0, N);
 
-					// get those nslots for uncoord DSCH
-					if ( i == (mstart + nslots) ) {
-						unsigned &mrange = nslots;
+			// get those nslots for uncoord DSCH
+			if ( mstart < N ) {
+				unsigned &mrange = nslots;
 
-						setSlots (uncoordsch_, 	f, 1, mstart, mrange, dst);
-		//				setSlots (grants_, 		f, 1, mstart, mrange, true);
-						setSlots (busy_, 		f, 1, mstart, mrange, true);
-						setSlots (self_tx_unavl_[0], f, 1, mstart, mrange, true);
+				table_.set (Alloc::F_UNCOORD, 	f, 1, mstart, mrange, dst);
+//				table_.set (Alloc::F_TX, 		f, 1, mstart, mrange, true);
+				slots_.mark (slots_.busy (), Slots::L_DEF, f, 1, mstart, mrange, true);
+				slots_.mark (slots_.selfTx (0), Slots::L_DEF, f, 1, mstart, mrange, true);
 
-						if ( WimaxDebug::trace("WBWM::searchTXslot") )
-							fprintf (stderr, "\t\trange [%d:%d] borrowed from service %d\n", mstart, mstart+mrange, serv);
+				if ( WimaxDebug::trace("WBWM::searchTXslot") )
+					fprintf (stderr, "\t\trange [%d:%d] borrowed from service %d\n", mstart, mstart+mrange, serv);
 
-						return;
-					}
-				}
+				return;
 			}
 		}
 
@@ -2540,8 +3049,9 @@ WimshBwManagerFairRR::searchTXslot (unsigned int ndx, unsigned int reqState)
 	send_rtps_together_[ndx] = true;
 }
 
+template<unsigned int S>
 void
-WimshBwManagerFairRR::printDataStructures (FILE* os)
+WimshBwManagerFairRR<S>::printDataStructures (FILE* os)
 {
 	const char* class_names[4] = { "BE", "nrtPS", "rtPS", "UGS" };
 
@@ -2563,3 +3073,8 @@ WimshBwManagerFairRR::printDataStructures (FILE* os)
 	for ( unsigned int s = 0 ; s < 4 ; s++ )
 		WimaxDebug::print (activeList_[s], os, "\t");
 }
+
+// instantiate the bandwidth manager for the supported slot capacities
+template class WimshBwManagerFairRR<64>;
+template class WimshBwManagerFairRR<128>;
+template class WimshBwManagerFairRR<256>;
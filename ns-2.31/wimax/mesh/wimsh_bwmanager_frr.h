@@ -24,6 +24,7 @@
 #include <wimsh_bwmanager.h>
 #include <wimsh_packet.h>
 #include <wimsh_mac.h>
+#include <wimsh_slots.h>
 
 #include <rng.h>
 #include <math.h>
@@ -31,10 +32,22 @@
 //! Fair round robin bandwidth manager for 802.16. Single-radio only.
 /*!
   :TODO: more documentation. Much more.
+
+  S is the capacity, in minislots per frame, of the slot-state engine
+  and of the bitmaps used when granting/confirming. It must not be
+  smaller than the number of minislots per frame of the PHY, which is
+  checked by initialize(). The MAC selects the smallest instantiation
+  that fits the PHY (64, 128 or 256 minislots), so that bitmaps are
+  one, two or four words long.
   */
+template<unsigned int S>
 class WimshBwManagerFairRR : public WimshBwManager {
-	//! Typedef for an array of bitsets (representing slots within frames).
-	typedef std::vector< std::bitset<MAX_SLOTS> > Bitmap;
+	//! Typedef for the slot-state engine.
+	typedef WimshSlotStore<HORIZON, S> Slots;
+	//! Typedef for a minislot bitmap of a frame.
+	typedef typename Slots::Row Row;
+	//! Typedef for a plane of the slot-state engine.
+	typedef typename Slots::Plane Plane;
 
 protected:
 	//! Descriptor of the internal status used by grantFit().
@@ -49,6 +62,9 @@ protected:
 		grantFitDesc () : first (true) { }
 	};
 
+	//! Stages of a request/grant/confirm handshake, as seen by the requester.
+	enum HandshakeStage { HS_BACKLOG = 0, HS_REQUEST, HS_GRANT, HS_CONFIRM, HS_USE };
+
 	//! Descriptor of neighbor information for bandwidth requesting/granting.
 	struct NeighDesc {
 		/*!
@@ -97,6 +113,29 @@ protected:
 		//! Level of requests received (slots/frame)
 		unsigned int level_in_;
 
+		//! Bytes granted to the output link and not used, since unusedFrame_.
+		/*!
+		  This value is reported by the MAC layer when there is nothing
+		  left to send, and it is used to trim the next bandwidth request.
+		  */
+		unsigned int unused_;
+		//! Frame from which unused_ is counted.
+		unsigned int unusedFrame_;
+
+		//! Frame by which the data requested on the input link is due.
+		/*!
+		  Only used for rtPS when granting by deadline. Zero if none.
+		  */
+		unsigned int deadline_;
+
+		//! Time at which each stage of the handshake on the output link was reached.
+		/*!
+		  Negative if not reached yet. A handshake starts when backlog
+		  is first reported and ends when the first confirmed minislot
+		  is used, at which point all the entries are reset.
+		  */
+		double hs_[HS_USE];
+
 		//! Create an empty descriptor.
 		NeighDesc () {
 			req_in_  = 0;
@@ -110,6 +149,10 @@ protected:
 			def_in_  = 0;
 			def_out_ = 0;
 			level_in_ = 0;
+			unused_ = 0;
+			unusedFrame_ = 0;
+			deadline_ = 0;
+			for ( unsigned int i = 0 ; i < HS_USE ; i++ ) hs_[i] = -1;
 		}
 	};
 
@@ -130,87 +173,80 @@ protected:
 	//! Active-list of neighbor descriptors for bandwidth granting/requesting.
 	CircularList<wimax::LinkId> activeList_[wimax::N_SERV_CLASS];
 
-	//! Neighbors's unavailabilities to transmit.
+	//! Slot-state engine, ie. unavailabilities of this node and its neighbors.
 	/*!
-	  This is a four-dimension bitmap.
-
-	  The first dimension is the neighbor index.
-	  The second dimension is the channel index.
-	  The third dimension is the frame index (modulo HORIZON).
-	  The fourth dimension is the slot index within a frame.
-
-	  The last two dimensions are embedded into the Bitmap type,
-	  which is a vector of bitsets.
-
-	  This data structure is used when granting bandwidth to neighbors.
-
-	  All the slots of the F-th frame of each neighbor for all channels
-	  are reset by handle(), where F is the frame number (modulo HORIZON)
-	  of the current data frame, at the end of each frame.
+	  There are five planes, each split into a default, UGS and nrtPS layer:
+
+	  - busy: the minislots where this node cannot receive/transmit;
+	    used when granting/confirming bandwidth
+	  - unconfirmed: the minislots granted to this node, not yet
+	    confirmed; updated when a grant addressed to this node is received.
+		 As soon as a slot is confirmed, it is marked as busy, so that
+		 the same slot can never be confirmed twice
+	  - selfRx: the <channel, frame, slot> where this node cannot receive;
+	    updated when a confirmation from a node which is not in this
+		 node's neighborhood is received; used when granting bandwidth
+	  - selfTx: the <channel, frame, slot> where this node cannot transmit;
+	    updated when a grant which is not addressed to this node is
+		 received; used when confirming bandwidth
+	  - neighTx: the <neighbor, channel, frame, slot> where a neighbor
+	    cannot transmit; used when granting bandwidth to neighbors
+
+	  The default and nrtPS layers of the current data frame become
+	  stale at the end of each frame, and they are reset on their next
+	  write. See WimshSlotStore.
 	  */
-	std::vector< std::vector< Bitmap > > neigh_tx_unavl_;
-	std::vector< std::vector< Bitmap > > neigh_tx_unavl_UGS_;
-	std::vector< std::vector< Bitmap > > neigh_tx_unavl_NRTPS_;
+	Slots slots_;
 
-	//! Combination of <channel, frame, slot> where this node cannot receive.
+	//! Updates of slots_ decoded from the IEs of the MSH-DSCH being received.
 	/*!
-	  Updated when a confirmation from a node which is not in this node's
-	  neighborhood is received.
-
-	  Used when granting bandwidth to neighbors.
-
-	  All the slots of the F-th frame for all channels
-	  are reset by handle(), where F is the frame number (modulo HORIZON)
-	  of the current data frame, at the end of each frame.
+	  They are applied at once by recvMshDsch(), after the availabilities
+	  and the grants have been processed, and before the requests.
 	  */
-	std::vector< Bitmap > self_rx_unavl_;
-	std::vector< Bitmap > self_rx_unavl_UGS_;
-	std::vector< Bitmap > self_rx_unavl_NRTPS_;
+	typename Slots::Batch batch_;
+
+	//! Direction of a reservation, as seen by this node.
+	enum RsvDirection { RSV_TX = 0, RSV_RX, N_RSV_DIR };
+
+	//! Descriptor of a reservation confirmed by or to this node.
+	struct Reservation {
+		//! First frame (absolute frame number).
+		unsigned int frame_;
+		//! Number of frames. If HORIZON or more, it never expires.
+		unsigned int frange_;
+		//! First minislot.
+		unsigned int start_;
+		//! Number of minislots.
+		unsigned int range_;
+		//! Create a reservation descriptor.
+		Reservation (unsigned int frame, unsigned int frange,
+				unsigned int start, unsigned int range) :
+			frame_ (frame), frange_ (frange), start_ (start), range_ (range) { }
+	};
 
-	//! Combination of <channel, frame, slot> where this node cannot transmit.
+	//! Registry of the active UGS reservations of this node.
 	/*!
-	  Updated when a grant which is not addressed to this node is received.
-
-	  Used when confirming bandwidth to neighbors.
-
-	  All the slots of the F-th frame for all channels
-	  are reset by handle(), where F is the frame number (modulo HORIZON)
-	  of the current data frame, at the end of each frame.
+	  There is one list per <neighbor, service class, direction>: the
+	  reservations confirmed by this node to a neighbor (RSV_TX), and
+	  those confirmed by a neighbor to this node (RSV_RX). It is used to
+	  locate the minislots of a reservation without scanning the whole
+	  allocation table. Entries may outlive (part of) their minislots,
+	  eg. when they are borrowed, thus the allocation table is always
+	  checked as well. Expired entries are removed when a new one is added.
 	  */
-	std::vector< Bitmap > self_tx_unavl_;
-	std::vector< Bitmap > self_tx_unavl_UGS_;
-	std::vector< Bitmap > self_tx_unavl_NRTPS_;
-
-	//! Two-dimension bitmap representing this node's unavailabilities.
-	/*!
-	  The bit busy_[F][S] is set (ie. true) if this node cannot
-	  receive/transmit in the minislot S of frame F.
+	std::vector< std::list<Reservation> > rsv_;
 
-	  This data structure is used when granting/confirming bandwidth.
+	//! Per-neighbor grant status used by requestGrant(). Scratch buffer.
+	std::vector<grantFitDesc> grantFitStatus_;
 
-	  The F-th entry of this data structure is reset by handle(), where
-	  F is the frame number (modulo HORIZON) of the current data frame
-	  at the end of each frame.
-	  */
-	Bitmap busy_;
-	Bitmap busy_UGS_;
-	Bitmap busy_NRTPS_;
+	//! Neighbors of the granter, used when processing grants. Scratch buffer.
+	std::vector<WimaxNodeId> gntNeigh_;
 
-	//! Two-dimension bitmap representing the slots unconfirmed by this node.
-	/*!
-	  Updated when a grant addressed to this node is received.
-	  Used to confirm only minislots that have not been reserved
-	  by other nodes. As soon as slot is confirmed, it is marked as
-	  busy (ie. the corresponding bit in busy_ is set to true) so that
-	  the same slot can never be confirmed twice.
+	//! Neighbors waiting for an uncoordinated rtPS MSH-DSCH, used by schedule(). Scratch buffer.
+	std::vector<unsigned int> rtpsNeigh_;
 
-	  The F-th entry of this data structure is reset by handle(), where
-	  F is the frame number (modulo HORIZON) of the current data frame
-	  at the end of each frame.
-	  */
-	Bitmap unconfirmedSlots_;
-	Bitmap unconfirmedSlots_UGS_;
-	Bitmap unconfirmedSlots_NRTPS_;
+	//! Unavailable minislots of each <channel, persistence> used by grantFit(). Scratch buffer.
+	std::vector<Row> grantFitWindow_;
 
 	//! List of unconfirmed grants directed to this node.
 	//std::list<WimshMshDsch::GntIE> unconfirmed_;
@@ -235,12 +271,40 @@ protected:
 	std::vector<bool> send_rtps_together_;
 
 	//! Regrant horizon offset, in frames. Set via Tcl. Default = 1.
+	/*!
+	  A grant which has not been confirmed within regrantDuration_
+	  handshakes plus regrantOffset_ frames since it was sent is
+	  reclaimed by regrant(). One more handshake is allowed, since the
+	  requester may not be able to confirm at its first opportunity. A grant waiting in grantWaiting_ is only
+	  reclaimed if it has not been sent by its first frame.
+	  */
 	unsigned int regrantOffset_;
 	//! Regrant horizon duration, in handshake periods. Set via Tcl. Default = 1.
 	unsigned int regrantDuration_;
 	//! True if the same horizon for granting should be used. Default = no.
+	/*!
+	  If true, the bandwidth reclaimed from a grant is only regranted if
+	  a new grant can still be placed within the horizon of the original one.
+	  */
 	bool sameRegrantHorizon_;
 
+	//! Descriptor of a grant sent by this node, not confirmed yet.
+	struct PendingGrant {
+		//! Index of the requester.
+		unsigned int ndx_;
+		//! Grant, as sent.
+		WimshMshDsch::GntIE gnt_;
+		//! Minislots of the grant confirmed so far.
+		Row confirmed_;
+		//! Frame at the end of which the grant is reclaimed.
+		unsigned int deadline_;
+		//! True if the grant has been added to an MSH-DSCH message.
+		bool sent_;
+	};
+
+	//! Grants sent by this node which wait for a confirmation.
+	std::list<PendingGrant> pendingGrants_;
+
 	//! True if unconfirmed bandwidth is regranted. Configured via Tcl.
 	bool regrantEnabled_;
 
@@ -283,6 +347,32 @@ protected:
 	//! True if the starting channel is picked up randomly when granting.
 	bool grantFitRandomChannel_;
 
+	//! True if the least loaded channel is considered first when granting.
+	bool grantFitLeastLoaded_;
+
+	//! Placement of a grant within the free minislots of a frame.
+	enum FitPlacement {
+		FIT_FIRST,  //!< first run long enough, from minislot zero
+		FIT_BEST,   //!< shortest run that fits, or longest one otherwise
+		FIT_NEXT,   //!< first run long enough, from the last grant onwards
+		FIT_END     //!< last run long enough, grant aligned to its end
+	};
+
+	//! Placement of grants into free minislots. Default: FIT_FIRST.
+	FitPlacement grantFitPlacement_;
+
+	//! Minislot after the last grant, used by FIT_NEXT.
+	unsigned int grantFitNext_;
+
+	//! Fixed grant start offset, in frames. Set via Tcl. Default = 0, ie. adaptive.
+	unsigned int grantStartFixed_;
+
+	//! Minimum adaptive grant start offset, in frames. Set via Tcl. Default = 2.
+	unsigned int grantStartMargin_;
+
+	//! True if rtPS bandwidth is granted by deadline. Set via Tcl. Default = false.
+	bool rtpsDeadline_;
+
 	//! Deadlock detection timeout, in units of MSH-DSCH opportunities.
 	/*!
 	  Zero means disabled.
@@ -323,6 +413,9 @@ public:
 	//! We sent out some data on a link (i.e. negative backlog).
 	void sent (WimaxNodeId nexthop, unsigned int bytes, unsigned int serv);
 
+	//! Some bytes granted to a service class on a link were not used by it.
+	void unused (WimaxNodeId nexthop, unsigned int bytes, unsigned int serv);
+
 	//! We received some new data addressed to this node.
 	void received (WimaxNodeId src, WimaxNodeId dst, unsigned char prio,
 			WimaxNodeId source, unsigned int bytes) {
@@ -335,8 +428,12 @@ public:
 	    Turn on/off availabilities advertising.
      - $mac bwmanager regrant [on|off]\n
 	    Turn on/off the regranting procedure.
-     - $mac bwmanager regrant-horizon x\n
-	    Set the regrant-horizon to x frames.
+     - $mac bwmanager regrant-offset x\n
+	    Set the regrant horizon offset to x frames.
+     - $mac bwmanager regrant-duration x\n
+	    Set the regrant horizon duration to x handshakes.
+     - $mac bwmanager regrant-same-horizon [on|off]\n
+	    Only regrant within the horizon of the original grant.
      - $mac bwmanager dd-timeout x\n
 	    Set the deadlock detection timeout to x MSH-DSCH opportunities.
      - $mac bwmanager round-duration x\n
@@ -350,8 +447,22 @@ public:
      - $mac bwmanager fairness [grant|regrant|request|no]\n
 	    Activate the fairness procedure when granting, or regranting,
 		 or requesting. When 'no' is specified, all of them are turned off.
-     - $mac bwmanager grant-fit channel [random|first]\n
+     - $mac bwmanager grant-fit channel [random|first|least-loaded]\n
 	    Choose the algorithm to fit the grant into the forthcoming frames.
+		 With 'least-loaded' the channel with the fewest busy minislots in
+		 the frame is tried first, then the others in order.
+     - $mac bwmanager grant-fit placement [first|best|next|end]\n
+	    Choose where to place the grant within the free minislots of a frame.
+     - $mac bwmanager grant-start [adaptive|x]\n
+	    Let grants start within a number of frames computed from the
+		 handshake times, or within x frames.
+     - $mac bwmanager grant-start-margin x\n
+	    Set the minimum adaptive grant start offset to x frames, in [1, HORIZON/4].
+     - $mac bwmanager rtps-deadline [on|off]\n
+	    Request rtPS bandwidth with the deadline of the queued data,
+		 which is set by the latency budget of its flows (see the
+		 'budget' command of the MAC MIB), and grant it by that deadline,
+		 serving the rtPS links with the least slack first.
 		 */
 	int command (int argc, const char*const* argv);
 
@@ -364,6 +475,12 @@ public:
 	 */
 	void searchTXslot (unsigned int ndx, unsigned int reqState);
 
+	//! Return the number of bytes allocated by the bandwidth manager.
+	/*!
+	  The slot-state engine usually accounts for most of them.
+	  */
+	unsigned long memory ();
+
 protected:
 	//! Invalidate the data structures' entries for the current frame.
 	void invalidate (unsigned int F);
@@ -377,6 +494,41 @@ protected:
 	//! Cancel UGS reservation for granter's neighbours and itself
 	void cancel_Granter (unsigned int ndx, unsigned char s);
 
+	//! Return the minislots of frame f whose attributes in table_ are equal to key's.
+	Row match (unsigned int f, const Alloc::Run& key, unsigned int fields) const {
+		Row m; table_.match (f, key, fields, m); return m; }
+
+	//! Return the registry list of a neighbor, service class and direction.
+	std::list<Reservation>& reservations (
+			unsigned int ndx, unsigned int s, RsvDirection dir) {
+		return rsv_[ ( ndx * wimax::N_SERV_CLASS + s ) * N_RSV_DIR + dir ]; }
+
+	//! Add a reservation to the registry.
+	void addReservation (unsigned int ndx, unsigned int s, RsvDirection dir,
+			unsigned int frame, unsigned int frange,
+			unsigned int start, unsigned int range);
+
+	//! Remove the reservations of service s within [start, start + range[.
+	void dropReservations (unsigned int s, unsigned int start, unsigned int range);
+
+	//! Locate the minislots of the reservations of a neighbor, frame by frame.
+	/*!
+	  The entries of the registry are removed. masks[i] is set to the
+	  minislots of frame fs + i, for each i in [0, HORIZON[, which still
+	  belong to the reservations, according to the allocation table.
+	  Return false if there are no reservations.
+	  */
+	bool locateReservations (unsigned int ndx, unsigned char s, RsvDirection dir,
+			unsigned int fs, std::vector<Row>& masks);
+
+	//! Clear the L_UGS layer of plane p over masks, as returned by locateReservations().
+	/*!
+	  The minislots which are common to all the frames are cleared
+	  over the whole horizon, the others frame by frame.
+	  */
+	void clearReservations (Plane p, unsigned int fs,
+			const std::vector<Row>& masks);
+
 private:
 	//! Decode grants/confirmations from an incoming MSH-DSCH message.
 	/*!
@@ -385,7 +537,7 @@ private:
 	  - for each grant addressed to this node, a confirmation is added
 	    to the pending list of confirmations (managed by confirm()),
 		 the granted minislots are marked as unconfirmed unavailable
-		 (in the unconfirmedSlots_ bitmap) and the amount of bandwidth
+		 (in the unconfirmed plane) and the amount of bandwidth
 		 granted by a neighbor is updated
 
 	  - for each grant not addressed to this node, an unavailability is
@@ -401,7 +553,7 @@ private:
 	void rcvGrants (WimshMshDsch* dsch);
 	//! Decode availabilities from an incoming MSH-DSCH message.
 	/*!
-	  We update the status of neigh_tx_unavail_ based on the received
+	  We update the status of the neighTx plane based on the received
 	  availabilities.
 	  */
 	void rcvAvailabilities (WimshMshDsch* dsch);
@@ -418,11 +570,11 @@ private:
 
 	  - try to send as many confirmation as possible, provided that
 	    the slots that have been granted are still available for
-		 transmission by this node (via the self_tx_unaval_ bitmap)
+		 transmission by this node (via the selfTx plane)
 	  - update the status of the cnf_out_ data structure
 	  - set the minislots reserved for transmission at this node, which
 	    will be used by the handle() function to trigger the packet
-		 scheduler at the MAC layer. Both self_tx_unavl_ and self_rx_unavl_
+		 scheduler at the MAC layer. Both the selfTx and selfRx planes
 		 are updated
 
      Note that the cnf_out_ data structure is updated with the number
@@ -447,21 +599,46 @@ private:
 	  */
 	void requestGrant (WimshMshDsch* dsch, unsigned int ndx, unsigned int serv);
 
-	//! Regrant as much as possible unconfirmed bandwidth.
+	//! Reclaim the unconfirmed minislots of the pending grants past their deadline.
+	/*!
+	  The minislots of the grant which have not been confirmed, and which
+	  are still allocated to it, are released in the forthcoming frames.
+	  The bytes that they carry are removed from the gnt_in_ counter of
+	  the requester, which is then added to the round-robin active list,
+	  so that the bandwidth is regranted by requestGrant(). If the
+	  fairRegrant_ flag is false, the requester is served first.
+
+	  UGS grants are not regranted. The number of minislots and bytes
+	  reclaimed are collected as wimsh_regnt_slots and wimsh_regnt_bytes.
+	  */
+	void regrant ();
+
+	//! Add a grant to ndx to the list of pending grants.
 	/*!
-	  Bandwidth is regranted on a round-robin fashion. If it is not possible
-	  to regrant bandwidth to a neighbor, then the behavior depends on the
-	  someFairness_ flag. If true, regranting stops immediately, and
-	  next regranting will begin from the current neighbor. On the other
-	  hand, if it is false, the neighbor is skipped and regranting continues
-	  over the remaining neighbors until either none of them can be
-	  served or there is not any more spare room in the MSH-DSCH message.
+	  If the grant has not been sent yet, because it waits in
+	  grantWaiting_, then its deadline is set by sentPendingGrant().
+	  */
+	void addPendingGrant (unsigned int ndx, const WimshMshDsch::GntIE& gnt,
+			bool sent);
 
-	  In any case, the gnt_in_ counter for this neighbor is not updated.
-	  In other words, the latter counts the bytes that have been granted
-	  the first time only.
+	//! Start the deadline of a pending grant taken from grantWaiting_.
+	void sentPendingGrant (const WimshMshDsch::GntIE& gnt);
+
+	//! Return true if frame f is within the persistence of a grant.
+	/*!
+	  The requester confirms a grant from the current frame onwards, thus
+	  a confirmation may start after the first frame of the grant.
 	  */
-	//void regrant (WimshMshDsch* dsch);
+	static bool covers (const WimshMshDsch::GntIE& gnt, unsigned int f) {
+		return f >= gnt.frame_ &&
+			f < gnt.frame_ + WimshMshDsch::pers2frames (gnt.persistence_); }
+
+	//! Account for a confirmation received from ndx.
+	/*!
+	  Return false if the confirmed minislots do not belong to any
+	  outstanding pending grant, eg. because they have been reclaimed.
+	  */
+	bool confirmPendingGrant (unsigned int ndx, const WimshMshDsch::GntIE& cnf);
 
 	//! Return the real number of frames for which the persistence is relevant.
 	/*!
@@ -478,11 +655,13 @@ private:
 	/*!
 	  The first fit is searched starting from the first minislot of
 	  the first frame in the first available channel.
-	  Persistence is always 1-frame.
 
-	  A slot in a frame on a channel is eligible to be granted to
-	  the requester if the corresponding entry in the following
-	  data structures are false: busy_, neigh_tx_unavl_, unconfirmed_.
+	  A slot on a channel is eligible to be granted to the requester if
+	  the corresponding entry in the following planes are false in all
+	  the frames covered by the persistence of the grant: busy, neighTx,
+	  selfRx, unconfirmed. If there is no room on any channel, then
+	  shorter persistences are tried, except for UGS. Bandwidth is only
+	  borrowed from other services if there is no room at all.
 
 	  If it is not possible to schedule bandwidth to ndx in the
 	  specified time window, then a grant with an empty minislot
@@ -493,6 +672,42 @@ private:
 		bool& room, bool& frame_room, grantFitDesc& status,
 		unsigned int serv_class, WimshMshDsch* dsch);
 
+	//! Select the minislots of a grant among the free ones of map.
+	/*!
+	  Only runs of at least minSlots free minislots in [0, N[ are
+	  considered, according to grantFitPlacement_. Return the first
+	  minislot and set range to the number of minislots granted, which
+	  is at most nSlots. Return N if there are no runs long enough.
+	  */
+	unsigned int place (const Row& map,
+			unsigned int minSlots, unsigned int nSlots, unsigned int N,
+			unsigned int& range);
+
+	//! Compute the minislots that cannot be granted over several persistences.
+	/*!
+	  The entry k of maps is the union of the eligibility rows of ndx on
+	  channel ch over the frames [frame, frame + pers2frames(ladder[k])[.
+	  The ladder must be sorted by decreasing persistence. The rows are
+	  or'ed one frame at a time, and no more frames are visited as soon
+	  as all the N minislots are unavailable.
+	  */
+	void window (unsigned int ndx, unsigned int ch, unsigned int frame,
+			const WimshMshDsch::Persistence* ladder, unsigned int nPers,
+			unsigned int N, Row* maps);
+
+	//! Return the minislots that may be borrowed in all frames [frame, frame + frames[.
+	/*!
+	  If ugs is true, these are the minislots reserved to UGS. Otherwise,
+	  they are the free minislots and those allocated to BE or nrtPS,
+	  except the ones reserved to the nrtPS minimum guarantee.
+	  The rows are and'ed one frame at a time.
+	  */
+	Row borrowable (unsigned int ndx, unsigned int ch,
+			unsigned int frame, unsigned int frames, bool ugs);
+
+	//! Collect the number of runs of free minislots and the longest one in frame F.
+	void fragmentation (unsigned int F);
+
 	//! TODO: Document realGrantStart
 	void realGrantStart (unsigned int ndx,
 		unsigned int gframe, unsigned char gstart,
@@ -501,7 +716,7 @@ private:
 	//! First-fit to confirm bandwidth (similar to grantFit).
 	/*!
 	  A slot in a frame on a channel is eligible to be confirmed
-	  if the corresponding entry of busy_ is false.
+	  if the corresponding entry of the busy and selfTx planes is false.
 	  */
 	void confFit (unsigned int f, unsigned int mstart,
 			unsigned int mrange, WimshMshDsch::GntIE& gnt, bool& room,
@@ -513,6 +728,63 @@ private:
 				  (fabs ( mac_->h (x)  - mac_->phyMib()->controlDuration() ))
 				/ mac_->phyMib()->frameDuration()); }
 
+	//! Return the number of frames within which a grant between this node and x may start.
+	/*!
+	  A grant to x is eligible over NOW + [H', H + 2H'], where H and H'
+	  are the handshake times of this node and of x, respectively.
+	  Thus, it may start up to H + H' frames after its first eligible
+	  frame, but not less than grantStartMargin_ frames, nor more than
+	  HORIZON / 4. If grantStartFixed_ is not zero, it is used instead.
+	  */
+	unsigned int grantStart (WimaxNodeId x) {
+		if ( grantStartFixed_ > 0 ) return grantStartFixed_;
+		unsigned int offset = handshake (mac_->nodeId()) + handshake (x);
+		if ( offset < grantStartMargin_ ) offset = grantStartMargin_;
+		return ( offset < HORIZON / 4 ) ? offset : HORIZON / 4; }
+
+	//! Return the number of frames within which a grant to ndx from frame may start.
+	/*!
+	  Same as above, but when granting rtPS bandwidth by deadline the
+	  offset is shortened so that the grant starts by the deadline of
+	  the requested data, though not earlier than grantStartMargin_ frames.
+	  */
+	unsigned int grantStart (unsigned int ndx, unsigned int serv, unsigned int frame) {
+		const unsigned int offset = grantStart (mac_->ndx2neigh (ndx));
+		const unsigned int d = neigh_[ndx][serv].deadline_;
+		if ( serv != wimax::RTPS || ! rtpsDeadline_ || d == 0 ) return offset;
+		const unsigned int slack =
+			( d > frame + grantStartMargin_ ) ? d - frame : grantStartMargin_;
+		return ( slack < offset ) ? slack : offset; }
+
+	//! Mark that the handshake on output link ndx for service serv reached a stage.
+	/*!
+	  The latency from the previous stage is collected, provided that
+	  the latter was reached and this stage was not. When the granted
+	  minislots are used, the end-to-end latency is also collected and
+	  a new handshake may start.
+	  */
+	void handshakeStage (unsigned int ndx, unsigned int serv, HandshakeStage stage);
+
+	//! Return true if the rtPS input link a is due before b.
+	/*!
+	  Links without a deadline come last.
+	  */
+	bool moreUrgent (unsigned int a, unsigned int b) {
+		const unsigned int da = neigh_[a][wimax::RTPS].deadline_;
+		const unsigned int db = neigh_[b][wimax::RTPS].deadline_;
+		return ( da > 0 && ( db == 0 || da < db ) ); }
+
+	//! Return the minimum number of minislots of a grant.
+	/*!
+	  That is, the smallest number of minislots whose duration, short
+	  preamble excluded, is not smaller than minGrant_ OFDM symbols.
+	  */
+	unsigned int minGrantSlots () {
+		const unsigned int sps = mac_->phyMib()->symPerSlot();
+		const unsigned int slots =
+			( minGrant_ + mac_->phyMib()->symShortPreamble() + sps - 1 ) / sps;
+		return ( slots > 0 ) ? slots : 1; }
+
 	//! Return the quantum value of a given input/output link, in bytes.
 	unsigned int quantum (unsigned int ndx, wimax::LinkDirection dir) {
 		return (unsigned int) (ceil(wm_.weight (ndx, dir) * roundDuration_)); }
@@ -28,6 +28,7 @@
 #include <wimsh_forwarding.h>
 #include <wimsh_bwmanager.h>
 #include <wimsh_bwmanager_frr.h>
+#include <wimsh_bwmanager_csch.h>
 #include <wimsh_coordinator.h>
 #include <wimsh_coordinator_std.h>
 #include <wimsh_scheduler.h>
@@ -120,6 +121,20 @@ WimshMacMib::command (int argc, const char*const* argv)
 			return TCL_ERROR;
 		}
 		return TCL_OK;
+	} else if ( argc == 4 && strcmp(argv[1], "budget") == 0 ) {
+		unsigned int fid = atoi (argv[2]);
+		double budget = atof (argv[3]);
+		if ( atoi (argv[2]) < 0 ) {
+			fprintf (stderr, "invalid flow ID '%d'\n", atoi (argv[2]));
+			return TCL_ERROR;
+		}
+		if ( budget < 0 ) {
+			fprintf (stderr, "invalid latency budget '%s' on flow ID %d. "
+					"Please choose a non-negative number of seconds\n", argv[3], fid);
+			return TCL_ERROR;
+		}
+		flow2budget_[fid] = budget;
+		return TCL_OK;
 	}
 
 	return TCL_ERROR;
@@ -182,6 +197,7 @@ WimshMac::WimshMac ()
 	topology_ = 0;
 	initialized_ = false;
 	bwmanager_ = 0;
+	scheduler_ = 0;
 	forwarding_ = 0;
 	coordinator_ = 0;
 	hSelf_ = 0;
@@ -196,6 +212,8 @@ WimshMac::WimshMac ()
 	scanStart_ = 0;
 	scanMode_ = false;
 	hErrorTagged_ = false;
+	reclaim_ = false;
+	compact_ = false;
 	mshDschAvgError_ = -1.0;
 	mshDschAvgGood_ = -1.0;
 }
@@ -218,6 +236,36 @@ WimshMac::command (int argc, const char*const* argv)
 		linkEstState_ = LE_SEND_CHALLENGE;
 		linkEstStart_ = NOW;
 		return TCL_OK;
+	} else if ( argc == 3 && strcmp (argv[1], "reclaim") == 0 ) {
+		if ( strcmp (argv[2], "on") == 0 ) {
+			reclaim_ = true;
+		} else if ( strcmp (argv[2], "off") == 0 ) {
+			reclaim_ = false;
+		} else {
+			fprintf (stderr, "invalid reclaim option '%s'. "
+					"Choose either 'on' or 'off'\n", argv[2]);
+			return TCL_ERROR;
+		}
+		return TCL_OK;
+	} else if ( argc == 3 && strcmp (argv[1], "compact") == 0 ) {
+		if ( initialized_ ) {
+			fprintf (stderr, "the compact mode must be set before "
+					"the MAC is initialized\n");
+			return TCL_ERROR;
+		}
+		if ( strcmp (argv[2], "on") == 0 ) {
+			compact_ = true;
+		} else if ( strcmp (argv[2], "off") == 0 ) {
+			compact_ = false;
+		} else {
+			fprintf (stderr, "invalid compact option '%s'. "
+					"Choose either 'on' or 'off'\n", argv[2]);
+			return TCL_ERROR;
+		}
+		return TCL_OK;
+	} else if ( argc == 2 && strcmp (argv[1], "memory-report") == 0 ) {
+		memoryReport ();
+		return TCL_OK;
 	} else if ( argc == 3 && strcmp (argv[1], "open-sponsor") == 0 ) {
 		sponsorId_ = (WimaxNodeId) atoi (argv[2]);
 		sponsorState_ = SS_SEND_REQ;
@@ -289,10 +337,21 @@ WimshMac::command (int argc, const char*const* argv)
 	} else if ( argc == 3 && strcmp (argv[1], "bwmanager") == 0 ) {
 		if ( strcmp (argv[2], "dummy") == 0 ) {
 			bwmanager_ = new WimshBwManagerDummy (this);
+		} else if ( strcmp (argv[2], "replay") == 0 ) {
+			bwmanager_ = new WimshBwManagerReplay (this);
 		// } else if ( strcmp (argv[2], "round-robin") == 0 ) {
 		//	bwmanager_ = new WimshBwManagerRoundRobin (this);
+		} else if ( strcmp (argv[2], "central") == 0 ) {
+			bwmanager_ = new WimshBwManagerCentral (this);
 		} else if ( strcmp (argv[2], "fair-rr") == 0 ) {
-			bwmanager_ = new WimshBwManagerFairRR (this);
+			// use the smallest bitmaps that fit the PHY, if already known
+			const unsigned int N = ( phyMib_ ) ? phyMib_->slotPerFrame() : 256;
+			if ( N <= 64 )
+				bwmanager_ = new WimshBwManagerFairRR<64> (this);
+			else if ( N <= 128 )
+				bwmanager_ = new WimshBwManagerFairRR<128> (this);
+			else
+				bwmanager_ = new WimshBwManagerFairRR<256> (this);
 		} else {
 			fprintf (stderr, "bandwidth manager '%s' not supported", argv[2]);
 			return TCL_ERROR;
@@ -413,6 +472,57 @@ WimshMac::command (int argc, const char*const* argv)
 	return TCL_ERROR;
 }
 
+WimshFragmentationBuffer*
+WimshMac::fragbuf (unsigned int ndx)
+{
+	if ( ! fragbuf_[ndx] ) fragbuf_[ndx] = new WimshFragmentationBuffer;
+	return fragbuf_[ndx];
+}
+
+WimaxReassemblyBuffer*
+WimshMac::reasbuf (unsigned int ndx)
+{
+	if ( ! reasbuf_[ndx] ) reasbuf_[ndx] = new WimaxReassemblyBuffer;
+	return reasbuf_[ndx];
+}
+
+void
+WimshMac::memoryReport ()
+{
+	unsigned long buffers = 0;
+	for ( unsigned int i = 0 ; i < nneighs_ ; i++ ) {
+		if ( fragbuf_[i] ) buffers += sizeof(WimshFragmentationBuffer);
+		if ( reasbuf_[i] ) buffers += sizeof(WimaxReassemblyBuffer);
+	}
+
+	// per-neighbor arrays of the MAC itself, map nodes included
+	const unsigned long mac =
+		neigh2ndx_.size() * ( sizeof(WimaxNodeId) + sizeof(unsigned int) +
+				4 * sizeof(void*) ) +
+		ndx2neigh_.capacity() * sizeof(WimaxNodeId) +
+		alpha_.capacity() * sizeof(unsigned int) +
+		profile_.capacity() * sizeof(wimax::BurstProfile) +
+		( fragbuf_.capacity() + reasbuf_.capacity() ) * sizeof(void*) +
+		( hNeigh_.capacity() + hNeighLast_.capacity() ) * sizeof(double) +
+		mshDschLinkQuality_.capacity() * sizeof(LinkQuality);
+
+	const unsigned long bwmanager = ( bwmanager_ ) ? bwmanager_->memory () : 0;
+	const unsigned long scheduler = ( scheduler_ ) ? scheduler_->memory () : 0;
+
+	const char* key[] = { "bwmanager", "scheduler", "buffers", "mac", "total" };
+	const unsigned long bytes[] = { bwmanager, scheduler, buffers, mac,
+		bwmanager + scheduler + buffers + mac };
+
+	Tcl_Interp* interp = Tcl::instance().interp();
+	Tcl_ResetResult (interp);
+	for ( unsigned int i = 0 ; i < sizeof(bytes) / sizeof(bytes[0]) ; i++ ) {
+		char value[32];
+		sprintf (value, "%lu", bytes[i]);
+		Tcl_AppendElement (interp, key[i]);
+		Tcl_AppendElement (interp, value);
+	}
+}
+
 void
 WimshMac::initialize ()
 {
@@ -450,8 +560,9 @@ WimshMac::initialize ()
 		ndx2neigh_[i] = neighbors[i];
 		profile_[i] = wimax::QPSK_1_2;
 		alpha_[i] = WimshPhyMib::alpha[wimax::QPSK_1_2];
-		fragbuf_[i] = new WimshFragmentationBuffer;
-		reasbuf_[i] = new WimaxReassemblyBuffer;
+		// in compact mode, they are created on their first use
+		fragbuf_[i] = ( compact_ ) ? 0 : new WimshFragmentationBuffer;
+		reasbuf_[i] = ( compact_ ) ? 0 : new WimaxReassemblyBuffer;
 		hNeigh_[i] = 0;
 		hNeighLast_[i] = 0;
 		mshDschLinkQuality_[i].frames_ =
@@ -1017,7 +1128,7 @@ WimshMac::recvBurst (WimshBurst* burst)
 					pdu->hdr().meshCid().dst() == nodeId_ ) {
 
 				Stat::put ("wimsh_mac_tpt", index_, pdu->size());
-				WimaxSdu* sdu = reasbuf_[neigh2ndx_[pdu->nodeId()]]->addPdu (pdu);
+				WimaxSdu* sdu = reasbuf (neigh2ndx_[pdu->nodeId()])->addPdu (pdu);
 				// if a full SDU is reassembled, then reschedule it to recvSDU
 				if ( sdu ) {
 					// compute the per-hop delay
@@ -1083,9 +1194,24 @@ WimshMac::receive (unsigned int channel)
 void
 WimshMac::transmit (unsigned int range, WimaxNodeId dst, unsigned int channel, unsigned int service)
 {
-	if ( WimaxDebug::trace ("WMAC::transmit" ) ) fprintf (stderr,
-			"%.9f WMAC::transmit   [%d] dst %d range %d chn %d serv %d",
-			NOW, nodeId_, dst, range, channel, service);
+	// the whole range is granted to one service class
+	unsigned int slots[wimax::N_SERV_CLASS];
+	for ( unsigned int s = 0 ; s < wimax::N_SERV_CLASS ; s++ ) slots[s] = 0;
+	slots[service] = range;
+
+	transmit (range, dst, channel, slots);
+}
+
+void
+WimshMac::transmit (unsigned int range, WimaxNodeId dst, unsigned int channel,
+		const unsigned int* slots)
+{
+	if ( WimaxDebug::trace ("WMAC::transmit" ) ) {
+		fprintf (stderr, "%.9f WMAC::transmit   [%d] dst %d range %d chn %d serv",
+				NOW, nodeId_, dst, range, channel);
+		for ( unsigned int s = 0 ; s < wimax::N_SERV_CLASS ; s++ )
+			if ( slots[s] > 0 ) fprintf (stderr, " %d/%d", s, slots[s]);
+	}
 
 	// dst's index
 	const unsigned int ndx = neigh2ndx_[dst];
@@ -1094,35 +1220,85 @@ WimshMac::transmit (unsigned int range, WimaxNodeId dst, unsigned int channel, u
 	// we account for the physical preamble that must be transmitted
 	unsigned int bytes = slots2bytes (ndx, range, true);
 
-	// create a new burst into the fragmentation buffer
-	bool room = fragbuf_[ndx]->newBurst (profile_[ndx], bytes, service);
-
 	if ( WimaxDebug::trace ("WMAC::transmit" ) ) fprintf (stderr,
-			" bytes %d room %d\n",
-			bytes, room);
+			" bytes %d\n", bytes);
+
+	// number of bytes of the burst used by each service class
+	unsigned int used[wimax::N_SERV_CLASS];
+	for ( unsigned int s = 0 ; s < wimax::N_SERV_CLASS ; s++ ) used[s] = 0;
 
-	// if there is room schedule more PDUs from the scheduler
-	if ( room ) scheduler_->schedule (*fragbuf_[ndx], dst, service);
+	// fill the burst with the PDUs of each service class, in priority
+	// order, the first one creating a new burst into the fragmentation buffer
+	bool first = true;
+	for ( int s = wimax::UGS ; s >= wimax::BE ; s-- ) {
+		if ( slots[s] == 0 ) continue;
+
+		// the preamble is accounted for by the first service class only
+		const unsigned int granted = slots2bytes (ndx, slots[s], first);
+
+		// the pending PDU of this class, if any, is added when
+		// the burst is created or resumed, and it counts as used
+		const unsigned int before = ( first ) ? 0 : fragbuf (ndx)->getBurst()->size();
+
+		bool room;
+		if ( first ) {
+			room = fragbuf (ndx)->newBurst (profile_[ndx], granted, s);
+		} else {
+			fragbuf (ndx)->extend (granted);
+			room = fragbuf (ndx)->resume (s);
+		}
+		first = false;
+
+		// if there is room schedule more PDUs from the scheduler
+		if ( room ) scheduler_->schedule (*fragbuf (ndx), dst, s);
+		used[s] = fragbuf (ndx)->getBurst()->size() - before;
+
+		// report the bytes of the grant that this class could not use
+		if ( reclaim_ && scheduler_->neighbor (ndx, s) == 0 && granted > used[s] )
+			bwmanager_->unused (dst, granted - used[s], s);
+	}
+
+	// lend the spare room to the other service classes towards dst,
+	// starting from the highest one
+	if ( reclaim_ ) {
+		for ( int s = wimax::UGS ; s >= wimax::BE ; s-- ) {
+			if ( fragbuf (ndx)->size() <= WimaxPdu::minSize() ) break;
+			if ( slots[s] > 0 || scheduler_->neighbor (ndx, s) == 0 ) continue;
+
+			const unsigned int before = fragbuf (ndx)->getBurst()->size();
+			if ( fragbuf (ndx)->resume (s) )
+				scheduler_->schedule (*fragbuf (ndx), dst, s);
+			const unsigned int lent = fragbuf (ndx)->getBurst()->size() - before;
+			used[s] += lent;
+
+			if ( lent > 0 ) {
+				Stat::put ("wimsh_reclaim_bytes", index_, lent);
+				if ( WimaxDebug::trace ("WMAC::transmit" ) ) fprintf (stderr,
+						"\tlent %d bytes to serv %d\n", lent, s);
+			}
+		}
+	}
 
 	// do not send out the buffer is there are not scheduled PDUs within
-	if ( fragbuf_[ndx]->getBurst()->npdus() == 0 ) {
+	if ( fragbuf (ndx)->getBurst()->npdus() == 0 ) {
 		if ( WimaxDebug::trace ("WMAC::transmit" ) ) fprintf (stderr,
 				"\tno scheduled PDUs within fragbuf_\n");
-		delete fragbuf_[ndx]->getBurst();
+		delete fragbuf (ndx)->getBurst();
 		return;
 	}
 
 	// if there are backlogged PDUs waiting to be sent to the current
 	// neighbor, but there is spare room into the granted set of slots,
 	// this means that some capacity could not be used => new backlog
-	// should be requested
+	// should be requested (for the highest granted class still backlogged)
 
-	const unsigned int spare =
-		( fragbuf_[ndx]->getBurst()->npdus() > 0 )
-		? bytes - fragbuf_[ndx]->getBurst()->size()
-		: bytes;
-	if ( scheduler_->neighbor (ndx, service) > 0 && spare > 0 )
-		bwmanager_->backlog (dst, spare, service);               // :TODO: check
+	const unsigned int spare = bytes - fragbuf (ndx)->getBurst()->size();
+	for ( int s = wimax::UGS ; s >= wimax::BE && spare > 0 ; s-- ) {
+		if ( slots[s] > 0 && scheduler_->neighbor (ndx, s) > 0 ) {
+			bwmanager_->backlog (dst, spare, s);               // :TODO: check
+			break;
+		}
+	}
 
 	// set transmission mode to the given channel
 	phy_[0]->setMode ( wimax::TX, channel_[channel] );
@@ -1133,7 +1309,7 @@ WimshMac::transmit (unsigned int range, WimaxNodeId dst, unsigned int channel, u
 	//   the fragmentation subheader itself
 	// - any other fragment adds an additional overhead equal to the
 	//   sum of the MAC header + any other subheaders, including fragmentation
-	WimshBurst::List& pdus = fragbuf_[ndx]->getBurst()->pdus();
+	WimshBurst::List& pdus = fragbuf (ndx)->getBurst()->pdus();
 	WimshBurst::List::const_iterator it = pdus.begin();
 
 	// look at the fragmentation subheader (if any) of each PDU
@@ -1164,11 +1340,12 @@ WimshMac::transmit (unsigned int range, WimaxNodeId dst, unsigned int channel, u
 	}
 
 	// transmit the burst to the PHY (unless it is empty)
-	WimshBurst* burst = fragbuf_[ndx]->getBurst();
+	WimshBurst* burst = fragbuf (ndx)->getBurst();
 	if ( burst->npdus() > 0 ) {
 		if ( WimaxDebug::trace ("WMAC::transmit" ) ) fprintf (stderr,
 				"\ttransmitting fragbuf_ with %d PDUs\n", burst->npdus());
-		bwmanager_->sent ( dst, burst->size(), service);
+		for ( unsigned int s = 0 ; s < wimax::N_SERV_CLASS ; s++ )
+			if ( used[s] > 0 ) bwmanager_->sent ( dst, used[s], s);
 		phy_[0]->sendBurst ( burst );
 	}
 }
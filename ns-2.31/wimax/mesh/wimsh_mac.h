@@ -82,6 +82,15 @@ class WimshMacMib : public TclObject {
 	  The precedence is zero by default.
 	  */
 	std::map<int, unsigned char> flow2drop_;
+	//! Map from ns2 packet flow ID to latency budget, in seconds.
+	/*!
+	  This allows the user to specify via TCL the maximum time that
+	  the SDUs of a flow may wait in the MAC queue of each node.
+	  It is only used to grant rtPS bandwidth by deadline.
+
+	  There is no budget (ie. zero) by default.
+	  */
+	std::map<int, double> flow2budget_;
 
 
 	//! Link structure
@@ -125,6 +134,9 @@ public:
 	//! Get the drop precedence for a given flow number.
 	unsigned char flow2drop (int flowId) {
 		return ( flow2drop_.count(flowId) == 1 ) ? flow2drop_[flowId] : 0; }
+	//! Get the latency budget for a given flow number, zero if none.
+	double flow2budget (int flowId) {
+		return ( flow2budget_.count(flowId) == 1 ) ? flow2budget_[flowId] : 0; }
 	//! Update burst profile
 	void updateBurstProfile ( WimaxNodeId src, WimaxNodeId dst, wimax::BurstProfile p );
 	//! Get burst profile
@@ -218,12 +230,14 @@ class WimshMac : public TclObject {
 	//! Array of fragmentation buffers (one for each neighbor).
 	/*!
 	  This data structure is created by the initialize() function.
+	  In compact mode, each buffer is created on its first use.
 	  */
 	std::vector<WimshFragmentationBuffer*> fragbuf_;
 
 	//! Array of reassembly buffers (one for each neighbor).
 	/*!
 	  This data structure is created by the initialize() function.
+	  In compact mode, each buffer is created on its first use.
 	  */
 	std::vector<WimaxReassemblyBuffer*> reasbuf_;
 
@@ -314,6 +328,25 @@ class WimshMac : public TclObject {
 	//! True if this node has to measure the estimation accuracy of H values.
 	bool hErrorTagged_;
 
+	//! True if granted minislots not used by their service class are lent. Set via Tcl.
+	/*!
+	  If a burst is not filled with PDUs of the service class which it
+	  has been granted to, then the remaining room is filled with PDUs
+	  of the other service classes directed to the same neighbor, in
+	  order of service class. The bytes of the grant which have not been
+	  used by its service class are reported to the bandwidth manager.
+	  */
+	bool reclaim_;
+
+	//! True if the per-neighbor structures are only created when used. Set via Tcl.
+	/*!
+	  This applies to the fragmentation/reassembly buffers and to the
+	  per-neighbor planes of the slot-state engine of the bandwidth
+	  manager, so that the links that never carry traffic cost little
+	  memory. Must be set before initialize(). Default = no.
+	  */
+	bool compact_;
+
 	//! This index is only used for statistical purposes. Set via Tcl.
 	unsigned int index_;
 
@@ -457,6 +490,17 @@ public:
 	//! Transmit data over a given channel. Single-radio only.
 	void transmit (unsigned int range, WimaxNodeId dst, unsigned int channel, unsigned int service);
 
+	//! Transmit data of several service classes over a given channel, in one burst.
+	/*!
+	  The entry s of the slots array (of N_SERV_CLASS elements) is
+	  the number of minislots of the range granted to service class s.
+	  The burst is filled with PDUs in order of service class, and the
+	  room left by a class is used by the following ones. The PHY
+	  preamble is only accounted for once.
+	  */
+	void transmit (unsigned int range, WimaxNodeId dst, unsigned int channel,
+			const unsigned int* slots);
+
 	//! Return the number of neighbors of this node.
 	unsigned int nneighs () { return nneighs_; }
 
@@ -469,6 +513,9 @@ public:
 	//! Return the index for statistical purposes.
 	unsigned int index () { return index_; }
 
+	//! Return true if the per-neighbor structures are only created when used.
+	bool compact () { return compact_; }
+
 protected:
 	//! Tcl interface.
 	virtual int command (int argc, const char*const* argv);
@@ -477,6 +524,15 @@ private:
 	//! Initialize MAC data structures, provided that all objects are defined.
 	void initialize ();
 
+	//! Set the Tcl result to the bytes used by this node, per component.
+	void memoryReport ();
+
+	//! Return the fragmentation buffer of a neighbor, creating it if needed.
+	WimshFragmentationBuffer* fragbuf (unsigned int ndx);
+
+	//! Return the reassembly buffer of a neighbor, creating it if needed.
+	WimaxReassemblyBuffer* reasbuf (unsigned int ndx);
+
 	//! Utility function to update H.
 	void updateH (double& h, double& last);
 
@@ -75,6 +75,9 @@ public:
 		unsigned char service_;
 		//! Reserved field (1 bit)
 		//bool reserved_;						!!! -1bit
+		//! Deadline frame number of the queued data (rtPS only), zero if none.
+		// Not in the standard. Here we use the full frame number.
+		unsigned int deadline_;
 
 		//! Return the size (in bytes) of this IE.
 		static unsigned int size () { return 3; }
@@ -53,6 +53,20 @@ WimshScheduler::command (int argc, const char * const* argv)
 	return TCL_ERROR;
 }
 
+unsigned long
+WimshScheduler::memory ()
+{
+	unsigned long bytes = bufSize_ +
+		cbr_.capacity() * sizeof(std::vector<Cbr>);
+	for ( unsigned int ndx = 0 ; ndx < cbr_.size() ; ndx++ ) {
+		bytes += cbr_[ndx].capacity() * sizeof(Cbr);
+		for ( unsigned int s = 0 ; s < cbr_[ndx].size() ; s++ )
+			bytes += ( cbr_[ndx][s].fwdbytes_.capacity() +
+			           cbr_[ndx][s].fwdquocient_.capacity() ) * sizeof(unsigned long);
+	}
+	return bytes;
+}
+
 /*
  *
  * class WimshSchedulerFifo
@@ -77,6 +91,9 @@ WimshSchedulerFifo::initialize ()
 	// resize the vectors of FIFO queues and sizes to the specified size
 	buffer_.resize (mac_->nneighs());
 	size_.resize (mac_->nneighs());
+
+	// the rates are not estimated, but may be queried anyway
+	cbr_.resize (mac_->nneighs(), std::vector<Cbr> (wimax::N_SERV_CLASS));
 }
 
 void
@@ -91,12 +91,31 @@ public:
 	//! Return the size, in bytes, of the queue to a neighbor (by index).
 	virtual unsigned int neighbor (unsigned ndx, unsigned int service) = 0;
 
+	//! Return true if the PDUs are queued separately for each service class.
+	/*!
+	  Otherwise, neighbor() returns the same backlog for all classes.
+	  */
+	virtual bool perService () { return true; }
+
 	//! Tcl interface via MAC.
 	virtual int command (int argc, const char*const* argv);
 
+	//! Return the earliest deadline of the PDUs queued to a neighbor (by index).
+	/*!
+	  The deadline of a PDU is the time it was buffered plus the latency
+	  budget of its flow. Return zero if no queued flow has a budget.
+	  */
+	virtual double deadline (unsigned ndx, unsigned int service) { return 0; }
+
 	//! Return the total buffer occupancy, in bytes.
 	virtual unsigned int bufSize () { return bufSize_; }
 
+	//! Return the number of bytes allocated by the scheduler.
+	/*!
+	  The queued PDUs are accounted for by their size.
+	  */
+	virtual unsigned long memory ();
+
 	//! Return the estimated traffic needs of service s towards node ndx.
 	unsigned long cbrQuocient (unsigned int ndx, unsigned int s) { return cbr_[ndx][s].quocient_; }
 
@@ -147,6 +166,15 @@ public:
 	//! Return the size, in bytes, of the queue to a neighbor.
 	unsigned int neighbor (unsigned ndx, unsigned int service) { return size_[ndx]; }
 
+	//! Return false: there is one queue per neighbor.
+	bool perService () { return false; }
+
+	//! Return the number of bytes allocated by the scheduler.
+	unsigned long memory () {
+		return WimshScheduler::memory () +
+			buffer_.capacity() * sizeof(std::queue<WimaxPdu*>) +
+			size_.capacity() * sizeof(unsigned int); }
+
 	//! Tcl interface via MAC.
 	int command (int argc, const char*const* argv);
 };
@@ -446,6 +446,48 @@ WimshSchedulerFairRR::recomputeCBR (WimaxPdu* pdu)
 	}
 }
 
+double
+WimshSchedulerFairRR::deadline (unsigned ndx, unsigned int s)
+{
+	CircularList<FlowDesc>& rr = link_[ndx][s].rr_;
+
+	// PDUs are served in FIFO order within a flow, thus only the
+	// head-of-line PDU of each flow is checked
+	double earliest = 0;
+	for ( unsigned int i = 0 ; i < rr.size() ; i++, rr.move () ) {
+		FlowDesc& desc = rr.current();
+		if ( desc.queue_.empty() ) continue;
+
+		WimaxSdu* sdu = desc.queue_.front()->sdu();
+		const double budget =
+			mac_->macMib()->flow2budget (HDR_IP(sdu->ip())->flowid());
+		if ( budget <= 0 ) continue;
+
+		const double d = sdu->timestamp() + budget;
+		if ( earliest == 0 || d < earliest ) earliest = d;
+	}
+	return earliest;
+}
+
+unsigned long
+WimshSchedulerFairRR::memory ()
+{
+	unsigned long bytes = WimshScheduler::memory () +
+		link_.capacity() * sizeof(std::vector<LinkDesc>) +
+		unfinishedRound_.capacity() * sizeof(std::vector<bool>);
+	for ( unsigned int ndx = 0 ; ndx < link_.size() ; ndx++ ) {
+		bytes += link_[ndx].capacity() * sizeof(LinkDesc) +
+			unfinishedRound_[ndx].capacity() / 8;
+		for ( unsigned int s = 0 ; s < link_[ndx].size() ; s++ ) {
+			CircularList<FlowDesc>& rr = link_[ndx][s].rr_;
+			bytes += rr.memory ();
+			for ( unsigned int i = 0 ; i < rr.size() ; i++, rr.move () )
+				bytes += rr.current().queue_.size() * sizeof(WimaxPdu*);
+		}
+	}
+	return bytes;
+}
+
 void
 WimshSchedulerFairRR::handle ()
 {
@@ -77,6 +77,10 @@ protected:
 		//! Returns true if two descriptors do not have the same src, dst and prio.
 		bool operator!= (const FlowDesc& x) const {
 			return ! ( *this == x ); }
+
+		//! Hash value of src, dst and prio, used by CircularList.
+		unsigned int hash () const {
+			return ( src_ * 65599U + dst_ ) * 16U + prio_; }
 	};
 
 	//! Link descriptor.
@@ -146,6 +150,12 @@ public:
 	//! Return the size, in bytes, of the queue to a neighbor (by index).
 	unsigned int neighbor (unsigned ndx, unsigned int service) { return link_[ndx][service].size_; }
 
+	//! Return the earliest deadline of the head-of-line PDUs queued to a neighbor.
+	double deadline (unsigned ndx, unsigned int service);
+
+	//! Return the number of bytes allocated by the scheduler.
+	unsigned long memory ();
+
 	//! Tcl interface via MAC.
 	int command (int argc, const char*const* argv);
 
@@ -0,0 +1,678 @@
+/*
+ *  Copyright (C) 2007 Dip. Ing. dell'Informazione, University of Pisa, Italy
+ *  http://info.iet.unipi.it/~cng/ns2mesh80216/
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA, USA
+ */
+
+#ifndef __NS2_WIMSH_SLOTS_H
+#define __NS2_WIMSH_SLOTS_H
+
+#include <wimax_debug.h>
+#include <wimax_slotmask.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <stdio.h>
+
+//! Slot-state engine of a bandwidth manager.
+/*!
+  Keeps track of the minislots that this node cannot use, or that it
+  cannot grant/confirm, over a time horizon of H frames. Frames are
+  addressed modulo H, ie. frame f refers to the only frame in
+  [current, current + H[ that is equal to f modulo H.
+
+  The state is organized into planes. Each plane is a bitmap of S
+  minislots per frame. There are five kinds of planes:
+  - BUSY, one per node: slots where this node cannot receive/transmit
+  - UNCONFIRMED, one per node: slots granted to this node, not confirmed yet
+  - SELF_RX, one per channel: slots where this node cannot receive
+  - SELF_TX, one per channel: slots where this node cannot transmit
+  - NEIGH_TX, one per <neighbor, channel>: slots where the neighbor
+    cannot transmit to this node
+
+  Each plane is further split into N_LAYERS service layers:
+  - L_DEF, which accounts for any service but UGS
+  - L_UGS, which accounts for UGS reservations only
+  - L_NRTPS, which accounts for the nrtPS minimum slots only
+
+  All the rows (ie. one frame of one layer of one plane) are stored
+  into a single contiguous array, frame-major, so that the whole state
+  of a frame lies in a single block of memory. A plane is identified by
+  the index of its first row within a frame block, as returned by
+  busy(), unconfirmed(), selfRx(), selfTx() and neighTx().
+
+  In addition, each frame block holds one eligibility row per
+  <neighbor, channel>, which caches the union of all the layers of the
+  busy, unconfirmed, selfRx and neighTx planes, ie. the minislots that
+  cannot be granted to that neighbor on that channel. Eligibility rows
+  are kept up to date by mark(): setting slots only needs to or the
+  new slots into the affected rows, while clearing slots recomputes
+  the affected rows of the modified frames only.
+
+  Each frame block is tagged with the (absolute) frame number it
+  belongs to. When the current frame is advanced, the block of the
+  frame just elapsed becomes stale: its L_DEF and L_NRTPS layers read
+  as empty, and they are actually cleared on the first write only.
+  The L_UGS layers are not affected, since UGS reservations span
+  the whole horizon.
+
+  UGS reservations marked over (at least) the whole horizon are stored
+  once per plane as a persistent row, which applies to all the frames,
+  rather than in each frame block. Thus, the L_UGS layer of a frame
+  is the union of its own row and the persistent row, minus the holes
+  of the frame, ie. the persistent slots that have been cleared in that
+  frame only. Holes are only allocated for the frames that have some.
+  The eligibility rows of a frame without holes do not include the
+  persistent rows, which are cached separately for all the frames.
+
+  Finally, the load of each <channel, frame> is counted, ie. the
+  number of minislots set in all the layers of the selfRx and neighTx
+  planes of that channel. The counters are updated with the difference
+  of the number of bits set in the modified rows, so that the load of a
+  channel is available in constant time. The holes of the persistent
+  rows are not accounted for.
+
+  In compact mode, the NEIGH_TX planes and the eligibility rows of a
+  neighbor are only allocated when its NEIGH_TX plane is first accessed,
+  ie. when the neighbor is first involved in a grant heard by this node
+  or is granted bandwidth by it. Until then, the plane is empty. The
+  frame blocks are then laid out again with the new stride, which is
+  done at most once per neighbor. The neighbors are thus assigned a
+  slot index, in the order they are allocated, which is used instead
+  of their index to address the planes and the eligibility rows.
+
+  Many updates can be recorded into a Batch, with the same interface
+  as mark(), and then applied at once by apply(). The updates of the
+  same row are merged into a single write, and the eligibility rows of
+  each plane are updated once per frame.
+  */
+template<unsigned int H, unsigned int S>
+class WimshSlotStore {
+public:
+	//! A row, ie. the minislot bitmap of one frame of one layer of a plane.
+	typedef WimaxSlotMask<S> Row;
+
+	//! Service layers of each plane.
+	enum Layer { L_DEF = 0, L_UGS, L_NRTPS, N_LAYERS };
+
+	//! Bitmasks of layers, to be used with any().
+	enum {
+		M_DEF   = 1 << L_DEF,
+		M_UGS   = 1 << L_UGS,
+		M_NRTPS = 1 << L_NRTPS,
+		M_ALL   = M_DEF | M_UGS | M_NRTPS
+	};
+
+	//! Identifier of a plane, ie. its row offset within a frame block.
+	typedef unsigned int Plane;
+
+	//! Set of updates recorded by mark(), to be applied by WimshSlotStore::apply().
+	/*!
+	  Each update of the L_DEF and L_NRTPS layers is split into one
+	  update per frame. The updates of the L_UGS layers are applied
+	  as they are via WimshSlotStore::mark(), since they may involve
+	  the persistent rows.
+	  */
+	class Batch {
+		friend class WimshSlotStore;
+
+		//! Update of one frame of one layer of one plane.
+		struct Update {
+			//! Frame block, ie. frame number modulo H.
+			unsigned int block_;
+			//! Row index within the frame block, ie. plane plus layer.
+			unsigned int row_;
+			//! Sequence number, so that updates are applied in order.
+			unsigned int seq_;
+			//! Minislots to be set or cleared.
+			Row mask_;
+			//! True if the minislots are set, false if cleared.
+			bool value_;
+			//! Order by frame block, then row, then sequence number.
+			bool operator< (const Update& u) const {
+				if ( block_ != u.block_ ) return block_ < u.block_;
+				if ( row_ != u.row_ ) return row_ < u.row_;
+				return seq_ < u.seq_; }
+		};
+
+		//! Update of the L_UGS layer, as passed to mark().
+		struct UgsUpdate {
+			Plane p_;
+			unsigned int fstart_;
+			unsigned int frange_;
+			unsigned int mstart_;
+			unsigned int mrange_;
+			bool value_;
+		};
+
+		//! Updates of the L_DEF and L_NRTPS layers.
+		std::vector<Update> rows_;
+		//! Updates of the L_UGS layers, in order.
+		std::vector<UgsUpdate> ugs_;
+		//! Next sequence number.
+		unsigned int seq_;
+
+	public:
+		//! Create an empty batch.
+		Batch () : seq_ (0) { }
+
+		//! Record the update of a range of minislots over a range of frames.
+		void mark (Plane p, Layer l,
+				unsigned int fstart, unsigned int frange,
+				unsigned int mstart, unsigned int mrange, bool value) {
+			if ( l == L_UGS ) {
+				UgsUpdate u = { p, fstart, frange, mstart, mrange, value };
+				ugs_.push_back (u);
+				return;
+			}
+			Update u;
+			u.row_ = p + l;
+			u.mask_ = Row::range (mstart, mrange);
+			u.value_ = value;
+			for ( unsigned int f = 0 ; f < frange ; f++ ) {
+				u.block_ = ( fstart + f ) % H;
+				u.seq_ = seq_++;
+				rows_.push_back (u);
+			} }
+
+		//! Return true if no update has been recorded.
+		bool empty () const { return rows_.empty () && ugs_.empty (); }
+	};
+
+protected:
+	//! Array of rows, frame-major.
+	std::vector<Row> rows_;
+	//! Number of neighbors with allocated planes.
+	unsigned int neighbors_;
+	//! Slot index of each neighbor, or UINT_MAX if not allocated yet.
+	std::vector<unsigned int> slot_;
+	//! Number of channels.
+	unsigned int channels_;
+	//! Number of rows per frame.
+	unsigned int stride_;
+	//! Index of the first eligibility row within a frame block.
+	unsigned int elig_;
+	//! Frame number each frame block belongs to.
+	std::vector<unsigned int> epoch_;
+	//! Current frame number.
+	unsigned int now_;
+
+	//! Persistent UGS row of each plane, indexed by plane / N_LAYERS.
+	std::vector<Row> persist_;
+	//! Union of the persistent rows of each <neighbor, channel>.
+	std::vector<Row> pelig_;
+	//! Holes in the persistent rows of each frame, one row per plane.
+	/*!
+	  The vector of a frame is empty if that frame has no holes.
+	  */
+	std::vector< std::vector<Row> > holes_;
+	//! True if some slots have been set in the L_UGS rows of a frame block.
+	std::vector<bool> local_;
+
+	//! Load of the L_DEF and L_NRTPS layers of each <frame block, channel>.
+	std::vector<int> load_;
+	//! Load of the L_UGS layers of each <frame block, channel>.
+	std::vector<int> ugsLoad_;
+	//! Load of the persistent rows of each channel.
+	std::vector<int> persistLoad_;
+
+public:
+	//! Create an empty store. Call initialize() before use.
+	WimshSlotStore () :
+		neighbors_ (0), channels_ (0), stride_ (0), elig_ (0), now_ (0) { }
+	//! Do nothing.
+	~WimshSlotStore () { }
+
+	//! Allocate the store for a given number of neighbors/channels, all clear.
+	/*!
+	  If compact is true, then the planes of the neighbors are allocated
+	  on their first access only.
+	  */
+	void initialize (unsigned int neighbors, unsigned int channels,
+			bool compact = false) {
+		slot_.resize (neighbors);
+		for ( unsigned int n = 0 ; n < neighbors ; n++ )
+			slot_[n] = ( compact ) ? UINT_MAX : n;
+		if ( compact ) neighbors = 0;
+		neighbors_ = neighbors;
+		channels_ = channels;
+		elig_ = N_LAYERS * ( 2 + 2 * channels + neighbors * channels );
+		stride_ = elig_ + neighbors * channels;
+		rows_.assign (H * stride_, Row());
+		epoch_.resize (H);
+		for ( unsigned int b = 0 ; b < H ; b++ ) epoch_[b] = absolute (b);
+		persist_.assign (elig_ / N_LAYERS, Row());
+		pelig_.assign (neighbors * channels, Row());
+		holes_.assign (H, std::vector<Row> ());
+		local_.assign (H, false);
+		load_.assign (H * channels, 0);
+		ugsLoad_.assign (H * channels, 0);
+		persistLoad_.assign (channels, 0); }
+
+	//! Set the current frame. Elapsed frames become stale.
+	void advance (unsigned int frame) { now_ = frame; }
+
+	//! Plane of the BUSY kind.
+	Plane busy () const { return 0; }
+	//! Plane of the UNCONFIRMED kind.
+	Plane unconfirmed () const { return N_LAYERS; }
+	//! Plane of the SELF_RX kind on a given channel.
+	Plane selfRx (unsigned int ch) const {
+		return N_LAYERS * ( 2 + ch ); }
+	//! Plane of the SELF_TX kind on a given channel.
+	Plane selfTx (unsigned int ch) const {
+		return N_LAYERS * ( 2 + channels_ + ch ); }
+	//! Plane of the NEIGH_TX kind of a given neighbor on a given channel.
+	/*!
+	  In compact mode, the planes of the neighbor are allocated, if needed.
+	  */
+	Plane neighTx (unsigned int ndx, unsigned int ch) {
+		if ( slot_[ndx] == UINT_MAX ) allocate (ndx);
+		return plane (slot_[ndx], ch); }
+
+	//! Return a row of the plane p, layer l, frame f (modulo H).
+	Row row (Plane p, Layer l, unsigned int f) const {
+		if ( l == L_UGS ) return ugs (p, f, true);
+		if ( stale (f) ) return Row ();
+		return rows_[ ( f % H ) * stride_ + p + l ]; }
+
+	//! Return the union of the rows of a set of layers of plane p, frame f.
+	Row any (Plane p, unsigned int f, unsigned int layers = M_ALL) const {
+		return sum (p, f, layers, true); }
+
+	//! Return the minislots of frame f that cannot be granted to ndx on ch.
+	Row eligible (unsigned int ndx, unsigned int ch, unsigned int f) const {
+		const unsigned int k = slot_[ndx];
+		if ( k == UINT_MAX ) return                 // empty NEIGH_TX plane
+			any (unconfirmed (), f) | any (busy (), f) | any (selfRx (ch), f);
+		if ( stale (f) ) return
+			any (unconfirmed (), f) | any (busy (), f) |
+			any (selfRx (ch), f) | any (plane (k, ch), f);
+		const unsigned int e = k * channels_ + ch;
+		if ( holes_[f % H].empty () )
+			return rows_[ ( f % H ) * stride_ + elig_ + e ] | pelig_[e];
+		return rows_[ ( f % H ) * stride_ + elig_ + e ]; }
+
+	//! Return the load of channel ch in frame f.
+	unsigned int load (unsigned int ch, unsigned int f) const {
+		const unsigned int i = ( f % H ) * channels_ + ch;
+		return ( ( stale (f) ) ? 0 : load_[i] ) + ugsLoad_[i] + persistLoad_[ch]; }
+
+	//! Set a range of minislots over a range of frames to a given value.
+	/*!
+	  If l is L_UGS and the range of frames covers the whole horizon,
+	  then the persistent row of the plane is modified instead.
+	  */
+	void mark (Plane p, Layer l,
+			unsigned int fstart, unsigned int frange,
+			unsigned int mstart, unsigned int mrange, bool value);
+
+	//! Return the number of bytes allocated by the store.
+	unsigned long memory () const {
+		unsigned long bytes = ( rows_.capacity() + persist_.capacity() +
+				pelig_.capacity() ) * sizeof(Row) +
+			( epoch_.capacity() + slot_.capacity() ) * sizeof(unsigned int) +
+			( load_.capacity() + ugsLoad_.capacity() +
+			  persistLoad_.capacity() ) * sizeof(int) +
+			holes_.capacity() * sizeof(std::vector<Row>) +
+			local_.capacity() / 8;
+		for ( unsigned int b = 0 ; b < holes_.size() ; b++ )
+			bytes += holes_[b].capacity() * sizeof(Row);
+		return bytes; }
+
+	//! Apply all the updates recorded into a batch, which is then emptied.
+	/*!
+	  The result is the same as calling mark() for each update, in
+	  the order they have been recorded.
+	  */
+	void apply (Batch& batch);
+
+protected:
+	//! Return the frame number that frame f (modulo H) refers to.
+	unsigned int absolute (unsigned int f) const {
+		return now_ + ( f % H + H - now_ % H ) % H; }
+	//! Plane of the NEIGH_TX kind of the neighbor with slot index k on a given channel.
+	Plane plane (unsigned int k, unsigned int ch) const {
+		return N_LAYERS * ( 2 + 2 * channels_ + k * channels_ + ch ); }
+	//! Allocate the planes of a neighbor, and lay out the frame blocks again.
+	void allocate (unsigned int ndx);
+	//! Return the channel of plane p, or channels_ if p is not bound to a channel.
+	/*!
+	  Only the selfRx and neighTx planes contribute to the load.
+	  */
+	unsigned int channel (Plane p) const {
+		if ( p >= plane (0, 0) ) return ( ( p - plane (0, 0) ) / N_LAYERS ) % channels_;
+		if ( p >= selfRx (0) && p < selfTx (0) ) return ( p - selfRx (0) ) / N_LAYERS;
+		return channels_; }
+	//! Add the difference of the number of slots set in a row to a load counter.
+	void account (unsigned int ch, unsigned int b, Layer l, int delta) {
+		if ( ch >= channels_ ) return;
+		if ( l == L_UGS ) ugsLoad_[b * channels_ + ch] += delta;
+		else              load_[b * channels_ + ch] += delta; }
+	//! Return true if the block of frame f belongs to an elapsed frame.
+	bool stale (unsigned int f) const {
+		return epoch_[f % H] != absolute (f); }
+
+	//! Return the L_UGS layer of plane p in frame f.
+	/*!
+	  The persistent row is only included if persistent is true.
+	  */
+	Row ugs (Plane p, unsigned int f, bool persistent) const {
+		Row map = rows_[ ( f % H ) * stride_ + p + L_UGS ];
+		if ( ! persistent ) return map;
+		const std::vector<Row>& holes = holes_[f % H];
+		if ( holes.empty () ) return map | persist_[p / N_LAYERS];
+		Row pers = persist_[p / N_LAYERS];
+		return map | pers.andNot (holes[p / N_LAYERS]); }
+
+	//! Return the union of a set of layers of plane p, frame f.
+	/*!
+	  The persistent row is only included if persistent is true.
+	  */
+	Row sum (Plane p, unsigned int f, unsigned int layers, bool persistent) const {
+		const Row* r = &rows_[ ( f % H ) * stride_ + p ];
+		if ( stale (f) ) layers &= M_UGS;
+		Row map;
+		if ( layers & M_DEF ) map |= r[L_DEF];
+		if ( layers & M_UGS ) map |= ugs (p, f, persistent);
+		if ( layers & M_NRTPS ) map |= r[L_NRTPS];
+		return map; }
+
+	//! Clear the stale layers of frame f before it is written.
+	void touch (unsigned int f);
+
+	//! Set the slots in mask of the persistent row of plane p to a given value.
+	void persistent (Plane p, const Row& mask, bool value);
+
+	//! Select the range of neighbors and channels affected by plane p.
+	/*!
+	  Return false if plane p is not an input of the eligibility rows.
+	  */
+	bool affected (Plane p, unsigned int& nfirst, unsigned int& nlast,
+			unsigned int& cfirst, unsigned int& clast) const;
+
+	//! Update the eligibility rows of frame f after plane p has been modified.
+	/*!
+	  If mask is not null, then the slots in mask have been set, otherwise
+	  some slots have been cleared and the rows are recomputed.
+	  */
+	void eligibility (Plane p, unsigned int f, const Row* mask);
+};
+
+template<unsigned int H, unsigned int S>
+void
+WimshSlotStore<H, S>::mark (Plane p, Layer l,
+		unsigned int fstart, unsigned int frange,
+		unsigned int mstart, unsigned int mrange, bool value)
+{
+	if ( WimaxDebug::trace ("WSLT::mark") ) fprintf (stderr,
+			"\tWSLT::mark\tplane %d layer %d fstart %d frange %d "
+			"mstart %d mrange %d val %d\n",
+			p, l, fstart, frange, mstart, mrange, value);
+
+	// the ranged mask is computed once and applied to each frame
+	const Row mask = Row::range (mstart, mrange);
+
+	if ( l == L_UGS && frange >= H ) {
+		persistent (p, mask, value);
+		return;
+	}
+
+	const unsigned int ch = channel (p);
+
+	for ( unsigned int f = 0 ; f < frange ; f++ ) {
+		const unsigned int b = ( fstart + f ) % H;
+		touch (b);
+		Row& r = rows_[ b * stride_ + p + l ];
+		const int before = r.count ();
+		if ( value ) r |= mask;
+		else         r.andNot (mask);
+		account (ch, b, l, (int) r.count () - before);
+
+		if ( l == L_UGS && value ) local_[b] = true;
+
+		// clearing persistent slots in this frame only makes holes
+		if ( l == L_UGS && ! value ) {
+			const Row hole = persist_[p / N_LAYERS] & mask;
+			std::vector<Row>& holes = holes_[b];
+			if ( hole.any () && holes.empty () ) {
+				holes.assign (elig_ / N_LAYERS, Row());
+				holes[p / N_LAYERS] = hole;
+				eligibility (busy (), b, 0);          // now includes persist_
+				continue;
+			}
+			if ( hole.any () ) holes[p / N_LAYERS] |= hole;
+		}
+
+		eligibility (p, b, ( value ) ? &mask : 0);
+	}
+}
+
+template<unsigned int H, unsigned int S>
+void
+WimshSlotStore<H, S>::apply (Batch& batch)
+{
+	std::vector<typename Batch::Update>& u = batch.rows_;
+
+	if ( WimaxDebug::trace ("WSLT::apply") ) fprintf (stderr,
+			"\tWSLT::apply\trows %d ugs %d\n", (int) u.size(), (int) batch.ugs_.size());
+
+	// updates of the same row are adjacent, in the order they were recorded
+	std::sort (u.begin(), u.end());
+
+	unsigned int i = 0;
+	while ( i < u.size() ) {
+		const unsigned int b = u[i].block_;
+		const Plane p = u[i].row_ - u[i].row_ % N_LAYERS;
+		const unsigned int ch = channel (p);
+		touch (b);
+
+		// slots set in any layer of the plane, and true if some are cleared
+		Row set;
+		bool cleared = false;
+
+		while ( i < u.size() && u[i].block_ == b &&
+				u[i].row_ - u[i].row_ % N_LAYERS == p ) {
+			const unsigned int row = u[i].row_;
+
+			// merge the updates of this row into one
+			Row on, off;
+			for ( ; i < u.size() && u[i].block_ == b && u[i].row_ == row ; i++ ) {
+				if ( u[i].value_ ) { on |= u[i].mask_; off.andNot (u[i].mask_); }
+				else               { off |= u[i].mask_; on.andNot (u[i].mask_); }
+			}
+
+			Row& r = rows_[ b * stride_ + row ];
+			const int before = r.count ();
+			r.andNot (off);
+			r |= on;
+			account (ch, b, (Layer) ( row % N_LAYERS ), (int) r.count () - before);
+
+			set |= on;
+			if ( off.any () ) cleared = true;
+		}
+
+		if ( cleared )         eligibility (p, b, 0);
+		else if ( set.any () ) eligibility (p, b, &set);
+	}
+	u.clear ();
+
+	// the L_UGS layers do not interfere with the other ones
+	for ( unsigned int j = 0 ; j < batch.ugs_.size() ; j++ ) {
+		const typename Batch::UgsUpdate& g = batch.ugs_[j];
+		mark (g.p_, L_UGS, g.fstart_, g.frange_, g.mstart_, g.mrange_, g.value_);
+	}
+	batch.ugs_.clear ();
+	batch.seq_ = 0;
+}
+
+template<unsigned int H, unsigned int S>
+void
+WimshSlotStore<H, S>::persistent (Plane p, const Row& mask, bool value)
+{
+	const unsigned int ch = channel (p);
+
+	Row& pers = persist_[p / N_LAYERS];
+	const int before = pers.count ();
+	if ( value ) pers |= mask;
+	else         pers.andNot (mask);
+	if ( ch < channels_ ) persistLoad_[ch] += (int) pers.count () - before;
+
+	// only the frames with holes, or with their own UGS slots which
+	// are now cleared, need to be updated
+	for ( unsigned int b = 0 ; b < H ; b++ ) {
+		std::vector<Row>& holes = holes_[b];
+		if ( holes.empty () && ( value || ! local_[b] ) ) continue;
+
+		if ( ! value ) {
+			Row& r = rows_[ b * stride_ + p + L_UGS ];
+			const int local = r.count ();
+			r.andNot (mask);
+			account (ch, b, L_UGS, (int) r.count () - local);
+		}
+
+		// the slots in mask are not holes anymore
+		if ( ! holes.empty () ) {
+			holes[p / N_LAYERS].andNot (mask);
+			bool none = true;
+			for ( unsigned int i = 0 ; none && i < holes.size() ; i++ )
+				none = holes[i].none ();
+			if ( none ) {
+				holes.clear ();
+				eligibility (busy (), b, 0);          // now excludes persist_
+				continue;
+			}
+		}
+
+		eligibility (p, b, ( value ) ? &mask : 0);
+	}
+
+	// recompute the persistent eligibility rows
+	unsigned int nfirst, nlast, cfirst, clast;
+	if ( ! affected (p, nfirst, nlast, cfirst, clast) ) return;
+	const Row node =
+		persist_[unconfirmed () / N_LAYERS] | persist_[busy () / N_LAYERS];
+	for ( unsigned int c = cfirst ; c < clast ; c++ ) {
+		const Row chan = node | persist_[selfRx (c) / N_LAYERS];
+		for ( unsigned int n = nfirst ; n < nlast ; n++ )
+			pelig_[n * channels_ + c] = chan | persist_[plane (n, c) / N_LAYERS];
+	}
+}
+
+template<unsigned int H, unsigned int S>
+void
+WimshSlotStore<H, S>::allocate (unsigned int ndx)
+{
+	if ( WimaxDebug::trace ("WSLT::allocate") ) fprintf (stderr,
+			"\tWSLT::allocate\tndx %d slot %d\n", ndx, neighbors_);
+
+	const unsigned int k = neighbors_++;
+	slot_[ndx] = k;
+
+	// the new planes go after the existing ones, so that the identifiers
+	// of the latter do not change, while the eligibility rows move
+	const unsigned int elig = elig_ + N_LAYERS * channels_;
+	const unsigned int stride = elig + neighbors_ * channels_;
+	std::vector<Row> rows (H * stride, Row());
+	for ( unsigned int b = 0 ; b < H ; b++ ) {
+		const Row* src = &rows_[b * stride_];
+		Row* dst = &rows[b * stride];
+		std::copy (src, src + elig_, dst);
+		std::copy (src + elig_, src + stride_, dst + elig);
+	}
+	rows_.swap (rows);
+	elig_ = elig;
+	stride_ = stride;
+
+	for ( unsigned int c = 0 ; c < channels_ ; c++ ) persist_.push_back (Row());
+	for ( unsigned int b = 0 ; b < H ; b++ )
+		if ( ! holes_[b].empty () ) holes_[b].resize (elig_ / N_LAYERS);
+
+	// the new planes are empty, thus they do not contribute to the load,
+	// while the eligibility rows must be computed from the other planes
+	const Row node =
+		persist_[unconfirmed () / N_LAYERS] | persist_[busy () / N_LAYERS];
+	for ( unsigned int c = 0 ; c < channels_ ; c++ ) {
+		pelig_.push_back (node | persist_[selfRx (c) / N_LAYERS]);
+		for ( unsigned int b = 0 ; b < H ; b++ ) eligibility (plane (k, c), b, 0);
+	}
+}
+
+template<unsigned int H, unsigned int S>
+void
+WimshSlotStore<H, S>::touch (unsigned int f)
+{
+	if ( ! stale (f) ) return;
+
+	Row* r = &rows_[ ( f % H ) * stride_ ];
+	for ( unsigned int i = 0 ; i < elig_ ; i += N_LAYERS ) {
+		r[i + L_DEF].reset ();
+		r[i + L_NRTPS].reset ();
+	}
+	for ( unsigned int c = 0 ; c < channels_ ; c++ ) load_[( f % H ) * channels_ + c] = 0;
+	epoch_[f % H] = absolute (f);
+	eligibility (busy (), f, 0);
+}
+
+template<unsigned int H, unsigned int S>
+bool
+WimshSlotStore<H, S>::affected (Plane p, unsigned int& nfirst, unsigned int& nlast,
+		unsigned int& cfirst, unsigned int& clast) const
+{
+	nfirst = 0; nlast = neighbors_;
+	cfirst = 0; clast = channels_;
+	if ( p >= selfTx (0) && p < plane (0, 0) ) {
+		return false;                               // selfTx is not an input
+	} else if ( p >= plane (0, 0) ) {
+		const unsigned int i = ( p - plane (0, 0) ) / N_LAYERS;
+		nfirst = i / channels_; nlast = nfirst + 1;
+		cfirst = i % channels_; clast = cfirst + 1;
+	} else if ( p >= selfRx (0) ) {
+		cfirst = ( p - selfRx (0) ) / N_LAYERS; clast = cfirst + 1;
+	}
+	return true;
+}
+
+template<unsigned int H, unsigned int S>
+void
+WimshSlotStore<H, S>::eligibility (Plane p, unsigned int f, const Row* mask)
+{
+	Row* e = &rows_[ ( f % H ) * stride_ + elig_ ];
+
+	unsigned int nfirst, nlast, cfirst, clast;
+	if ( ! affected (p, nfirst, nlast, cfirst, clast) ) return;
+
+	// slots have been set: the cached rows only need to be extended
+	if ( mask ) {
+		for ( unsigned int n = nfirst ; n < nlast ; n++ )
+			for ( unsigned int c = cfirst ; c < clast ; c++ )
+				e[n * channels_ + c] |= *mask;
+		return;
+	}
+
+	// slots have been cleared: recompute the rows from their inputs
+	// (the persistent rows are included only if the frame has holes)
+	const bool pers = ! holes_[f % H].empty ();
+	Row node = sum (unconfirmed (), f, M_ALL, pers) | sum (busy (), f, M_ALL, pers);
+	for ( unsigned int c = cfirst ; c < clast ; c++ ) {
+		Row chan = node | sum (selfRx (c), f, M_ALL, pers);
+		for ( unsigned int n = nfirst ; n < nlast ; n++ )
+			e[n * channels_ + c] = chan | sum (plane (n, c), f, M_ALL, pers);
+	}
+}
+
+#endif // __NS2_WIMSH_SLOTS_H
@@ -44,6 +44,7 @@ WimshTopologySimple::WimshTopologySimple ()
 {
 	update_ = true;
 	nextLink_ = 1;
+	capacity_ = 0;
 }
 
 int WimshTopologySimple::command (int argc, const char*const* argv)
@@ -93,6 +94,83 @@ int WimshTopologySimple::command (int argc, const char*const* argv)
 		recompute ();
 		return TCL_OK;
 	}
+	/*
+    * set the rate that can be reserved to real-time flows, in b/s
+    */
+	else if ( argc == 3 && strcmp (argv[1], "admission-capacity") == 0 ) {
+		const double rate = atof (argv[2]);
+		if ( rate < 0 ) {
+			fprintf (stderr, "invalid admission capacity '%s'\n", argv[2]);
+			return TCL_ERROR;
+		}
+		capacity_ = rate;
+		return TCL_OK;
+	}
+	/*
+    * admit a new real-time flow with a declared rate, in b/s
+    * return 'accept', 'downgrade' or 'reject'
+    */
+	else if ( ( argc == 6 || argc == 7 ) && strcmp (argv[1], "admit") == 0 ) {
+		const int fid = atoi (argv[2]);
+		const int src = atoi (argv[3]);
+		const int dst = atoi (argv[4]);
+		const double rate = atof (argv[5]);
+		const unsigned int N = connectivity_.getRows();
+		if ( fid < 0 || src < 0 || dst < 0 ||
+				(unsigned int) src >= N || (unsigned int) dst >= N || rate < 0 ) {
+			fprintf (stderr, "invalid admit command on flow ID '%s'\n", argv[2]);
+			return TCL_ERROR;
+		}
+		bool downgrade = false;
+		if ( argc == 7 ) {
+			if ( strcmp (argv[6], "downgrade") == 0 ) {
+				downgrade = true;
+			} else {
+				fprintf (stderr, "invalid admit option '%s'. "
+						"Please choose 'downgrade'\n", argv[6]);
+				return TCL_ERROR;
+			}
+		}
+		const Admission outcome = admit (fid, src, dst, rate, downgrade);
+		Tcl::instance().result (
+				( outcome == ADMIT_ACCEPT )    ? "accept" :
+				( outcome == ADMIT_DOWNGRADE ) ? "downgrade" : "reject");
+		return TCL_OK;
+	}
+	/*
+    * release the capacity reserved to a flow
+    */
+	else if ( argc == 3 && strcmp (argv[1], "release") == 0 ) {
+		flows_.erase (atoi (argv[2]));
+		return TCL_OK;
+	}
+	/*
+    * return the list of flows with a given admission outcome
+    */
+	else if ( argc == 3 && strcmp (argv[1], "admission") == 0 ) {
+		Admission outcome;
+		if ( strcmp (argv[2], "accept") == 0 ) {
+			outcome = ADMIT_ACCEPT;
+		} else if ( strcmp (argv[2], "downgrade") == 0 ) {
+			outcome = ADMIT_DOWNGRADE;
+		} else if ( strcmp (argv[2], "reject") == 0 ) {
+			outcome = ADMIT_REJECT;
+		} else {
+			fprintf (stderr, "invalid admission outcome '%s'. "
+					"Please choose 'accept', 'downgrade' or 'reject'\n", argv[2]);
+			return TCL_ERROR;
+		}
+		Tcl_Interp* interp = Tcl::instance().interp();
+		Tcl_ResetResult (interp);
+		std::map<int, Flow>::iterator it;
+		for ( it = flows_.begin() ; it != flows_.end() ; ++it ) {
+			if ( it->second.outcome_ != outcome ) continue;
+			char fid[16];
+			sprintf (fid, "%d", it->first);
+			Tcl_AppendElement (interp, fid);
+		}
+		return TCL_OK;
+	}
 	return command (argc, argv);
 }
 
@@ -253,7 +331,8 @@ WimshTopologySimple::interfere (
 	// if there is not any link from a to b or from x to y return false
 	if ( connectivity_.at(a, b) == 0 || connectivity_.at(x, y) == 0 ) return false;
 
-	return conflict_.at (connectivity_.at(a, b), connectivity_.at(x, y));
+	// link identifiers start from one, conflict matrix indices from zero
+	return conflict_.at (connectivity_.at(a, b) - 1, connectivity_.at(x, y) - 1);
 }
 
 
@@ -413,6 +492,78 @@ WimshTopologySimple::getMaxTwoHopNeighborhood ()
 	return oldNeigh;
 }
 
+bool
+WimshTopologySimple::path (WimaxNodeId src, WimaxNodeId dst,
+		std::vector<unsigned int>& links)
+{
+	if ( ! update_ ) recompute();
+
+	links.clear();
+	for ( WimaxNodeId x = src ; x != dst ; ) {
+		const WimaxNodeId y = nextHop (x, dst);
+
+		// nodes cannot reach each other
+		if ( y >= numNodes() || connectivity_.at (x, y) == 0 ||
+				links.size() >= numNodes() ) { links.clear(); return false; }
+
+		// link identifiers start from one, conflict matrix indices from zero
+		links.push_back (connectivity_.at (x, y) - 1);
+		x = y;
+	}
+	return true;
+}
+
+double
+WimshTopologySimple::load (unsigned int l)
+{
+	double rate = 0;
+	std::map<int, Flow>::iterator it;
+	for ( it = flows_.begin() ; it != flows_.end() ; ++it ) {
+		if ( it->second.outcome_ != ADMIT_ACCEPT ) continue;
+		const std::vector<unsigned int>& links = it->second.links_;
+		for ( unsigned int i = 0 ; i < links.size() ; i++ )
+			if ( conflicting (l, links[i]) ) rate += it->second.rate_;
+	}
+	return rate;
+}
+
+WimshTopologySimple::Admission
+WimshTopologySimple::admit (int fid, WimaxNodeId src, WimaxNodeId dst,
+		double rate, bool downgrade)
+{
+	// a flow admitted again releases its previous reservation
+	flows_.erase (fid);
+
+	Flow flow;
+	flow.rate_ = rate;
+	flow.outcome_ = ADMIT_ACCEPT;
+
+	// there is no capacity at all between disconnected nodes
+	if ( ! path (src, dst, flow.links_) ) {
+		flow.outcome_ = ADMIT_REJECT;
+		flows_[fid] = flow;
+		return flow.outcome_;
+	}
+
+	// check every link along the path against its conflict domain
+	for ( unsigned int i = 0 ; capacity_ > 0 && i < flow.links_.size() ; i++ ) {
+		const unsigned int l = flow.links_[i];
+
+		// the hops of the new flow itself compete for the same capacity
+		double needed = load (l);
+		for ( unsigned int j = 0 ; j < flow.links_.size() ; j++ )
+			if ( conflicting (l, flow.links_[j]) ) needed += rate;
+
+		if ( needed > capacity_ ) {
+			flow.outcome_ = ( downgrade ) ? ADMIT_DOWNGRADE : ADMIT_REJECT;
+			break;
+		}
+	}
+
+	flows_[fid] = flow;
+	return flow.outcome_;
+}
+
 void
 WimshTopologySimple::dump (FILE* os)
 {
@@ -25,6 +25,7 @@
 #include <rng.h>
 
 #include <vector>
+#include <map>
 
 // struct used in computeGroupsEur().
 struct lista_{
@@ -148,6 +149,32 @@ class WimshTopologySimple : public WimshTopology {
 	  */
 	RNG rng;
 
+public:
+	//! Outcome of the admission control of a real-time flow.
+	enum Admission { ADMIT_ACCEPT, ADMIT_DOWNGRADE, ADMIT_REJECT };
+
+private:
+	//! Real-time flow known to the admission controller.
+	struct Flow {
+		//! Links along the path, as indices of the conflict matrix.
+		std::vector<unsigned int> links_;
+		//! Declared rate, in b/s.
+		double rate_;
+		//! Outcome of the admission control.
+		Admission outcome_;
+	};
+
+	//! Real-time flows known to the admission controller, by ns2 flow ID.
+	std::map<int, Flow> flows_;
+
+	//! Rate that can be reserved within each conflict domain, in b/s.
+	/*!
+	  This is the capacity left to UGS and rtPS flows, ie. it should
+	  not include the minimum guarantee of nrtPS. Zero means that
+	  all flows are accepted. Set via Tcl.
+	  */
+	double capacity_;
+
 public:
 	//! Create an empty topology object.
 	WimshTopologySimple ();
@@ -180,7 +207,32 @@ public:
 	//! Return the number of node in the scenario
 	unsigned int numNodes() { return connectivity_.getRows(); }
 
+	//! Check whether a new real-time flow fits the capacity left along its path.
+	/*!
+	  Each link along the path from src to dst must be able to carry
+	  the new flow in addition to the flows already accepted, counting
+	  once every hop of every accepted flow over the links that conflict
+	  with it, including the link itself. If the new flow does not fit,
+	  it is downgraded, if allowed, or rejected. Either way, the outcome
+	  is recorded and only accepted flows count against the capacity.
+	  A flow whose destination cannot be reached from its source is
+	  always rejected.
+	  */
+	Admission admit (int fid, WimaxNodeId src, WimaxNodeId dst,
+			double rate, bool downgrade);
+
 protected:
+	//! Return the links along the path from src to dst.
+	/*!
+	  Return false, with an empty list of links, if dst cannot be
+	  reached from src.
+	  */
+	bool path (WimaxNodeId src, WimaxNodeId dst, std::vector<unsigned int>& links);
+	//! Return the rate reserved by the accepted flows over the links conflicting with l.
+	double load (unsigned int l);
+	//! Return true if links i and j (indices of the conflict matrix) cannot be active together.
+	bool conflicting (unsigned int i, unsigned int j) {
+		return ( i == j || conflict_.at (i, j) ); }
 	//! Compute the conflict and apsp matrices.
 	void recompute ();
 	//! Dump the content of all the graphs to the specified stream.
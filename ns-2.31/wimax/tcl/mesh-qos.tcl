@@ -185,6 +185,16 @@ set opt(trfstart) { }
 set opt(trfstop)  { }
 set opt(trfclass) { }
 
+#
+# admission control of UGS and rtPS flows, on their declared rate
+#
+set opt(admission)            "off"  ;# {on, off}
+set opt(admission-capacity)   0      ;# reservable rate per conflict domain, in b/s
+set opt(admission-downgrade)  "on"   ;# downgrade to nrtPS instead of rejecting
+set opt(declared-rate)        { }    ;# declared rate of each flow, per source, in b/s
+                                     ;# if unspecified, the cbr/bwa rate is used,
+                                     ;# while flows of other traffic types are rejected
+
 #
 # VoIP traffic
 #
@@ -256,6 +266,12 @@ proc create_connections {} {
    set flows(rtps) 0
    set flows(nrtps) 0
    set flows(be) 0
+   set flows(downgraded) 0
+   set flows(rejected) 0
+
+   if { $opt(admission) == "on" } {
+	$topo admission-capacity $opt(admission-capacity)
+   }
 
    for { set flowid 0 } { $flowid < $opt(nflow) } {incr flowid} {
 	# if there is a default service class, use it
@@ -392,6 +408,49 @@ proc create_connections {} {
 		}
 	}
 
+	# check whether there is room for a real-time flow along its path
+	if { $opt(admission) == "on" && ( $class == "ugs" || $class == "rtps" ) } {
+		# the declared rate, if any, otherwise that of the traffic model
+		set declared ""
+		if { [llength $opt(declared-rate)] > $flowid } {
+			set declared [lindex $opt(declared-rate) $flowid]
+		} elseif { $traffic == "cbr" } {
+			set declared $rate
+		} elseif { $traffic == "bwa" } {
+			set declared $opt(bwa-rate)
+		}
+
+		if { $declared == "" } {
+			if { $opt(debuglevel) > 1 } {
+				puts "\[2\](flow) * flow $flowid has no declared rate for $traffic traffic"
+			}
+			set outcome "reject"
+		} elseif { $opt(admission-downgrade) == "on" } {
+			set outcome [$topo admit $flowid $src $dst \
+				[expr $declared * $nsources] downgrade]
+		} else {
+			set outcome [$topo admit $flowid $src $dst [expr $declared * $nsources]]
+		}
+
+		if { $outcome == "downgrade" } {
+			if { $opt(debuglevel) > 1 } {
+				puts "\[2\](flow) * flow $flowid downgraded from $class to nrtps"
+			}
+			incr flows($class) -1
+			incr flows(nrtps)
+			incr flows(downgraded)
+			set class "nrtps"
+			set prio 3
+		} elseif { $outcome == "reject" } {
+			if { $opt(debuglevel) > 1 } {
+				puts "\[2\](flow) * flow $flowid rejected"
+			}
+			incr flows($class) -1
+			incr flows(rejected)
+			continue
+		}
+	}
+
 	# print some debug info about this flow
 	if { $opt(debuglevel) > 1 } {
 		puts "\[2\](flow) * creating flow $flowid ($src -> $dst) with priority $prio"
@@ -484,6 +543,10 @@ if { $opt(debuglevel) > 0 } {
 	puts "\[1\](info) $flows(rtps) rtPS flow(s)"
 	puts "\[1\](info) $flows(nrtps) nrtPS flow(s)"
 	puts "\[1\](info) $flows(be) BE flow(s)"
+	if { $opt(admission) == "on" } {
+		puts "\[1\](info) $flows(downgraded) flow(s) downgraded: [$topo admission downgrade]"
+		puts "\[1\](info) $flows(rejected) flow(s) rejected: [$topo admission reject]"
+	}
 }
 
 create_profiles